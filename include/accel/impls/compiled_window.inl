@@ -0,0 +1,125 @@
+#include <iterator>
+
+namespace accel
+{
+    // Front end of the compiled accel-window library. The backend lives in the library behind a
+    // pointer, so including this header pulls in none of the platform headers. Only poll_events
+    // stays a template and copies out of a batch decoded by the library.
+    class window
+    {
+    public:
+        using command_t = std::function<void(window&)>;
+
+        window(const window_create_params& params);
+        ~window();
+
+        window(const window&) = delete;
+        window& operator=(const window&) = delete;
+
+        window(window&&) noexcept;
+        window& operator=(window&&) noexcept;
+
+        unsigned int get_client_width() const;
+        unsigned int get_client_height() const;
+        unsigned int get_width() const;
+        unsigned int get_height() const;
+        int get_x() const;
+        int get_y() const;
+
+        bool is_closing() const;
+        bool is_resizable() const;
+        bool is_undecorated() const;
+        bool is_hidden() const;
+        bool is_fullscreen() const;
+        bool is_hiding_mouse() const;
+        bool is_trapping_mouse() const;
+        flagset<window_style_bits> get_style() const;
+        flagset<event_types> get_event_subscription() const;
+        visibility_states get_visibility() const;
+        bool is_occluded() const;
+        bool is_active() const;
+        bool is_key_down(unsigned int keycode) const;
+        bool is_button_down(mouse_buttons button) const;
+        input_state get_input_state() const;
+        const window_stats& stats() const;
+        window_state get_state() const;
+
+        utf8::string get_title() const;
+        void set_title(const utf8::string& title);
+        void set_position(int x, int y);
+        void set_size(unsigned int width, unsigned int height);
+        void set_client_size(unsigned int width, unsigned int height);
+        void set_rect(int x, int y, unsigned int width, unsigned int height);
+        void set_resizable(bool state);
+        void set_undecorated(bool state);
+        void set_hidden(bool state);
+
+        // Fullscreen on the output with the given id, 0 leaves the choice to the platform. is_fullscreen() follows
+        // once the window manager or compositor has actually made the window fullscreen.
+        void set_fullscreen(bool state, std::uint64_t output_id = 0);
+        compositor_bypass_states get_bypass_state() const;
+
+        void set_hide_mouse(bool state);
+        void set_trap_mouse(bool state);
+        void set_style(const flagset<window_style_bits>& style);
+        void set_event_subscription(const flagset<event_types>& events);
+
+        // Applies the title, client size, style and subscription of params in one batch
+        void retarget(const window_create_params& params);
+
+        // Scale of the rendered buffer relative to the client size, only honoured on Wayland with wp_viewporter
+        void set_render_scale(float scale);
+        float get_render_scale() const;
+
+        // Monitors with their refresh rate, and the ones the window is currently shown on
+        std::vector<output_info> get_outputs() const;
+        std::vector<std::uint64_t> get_current_outputs() const;
+
+        // Every pointer position decoded by the last poll_events, oldest first, for predicting the cursor ahead of a frame
+        const std::vector<motion_sample>& get_motion_history() const;
+
+        // Can be called from any thread, the command runs on the owning thread during its next poll_events
+        std::future<void> post(command_t command);
+
+        // Display connection and surface of the active backend: Display* and Window on X11,
+        // wl_display* and wl_surface* on Wayland, nullptr and HWND on Win32
+        void* get_native_display() const;
+        void* get_native_surface() const;
+
+#if !defined(PLATFORM_WINDOWS)
+        // File descriptors that become readable when poll_events has something to decode, poll once before blocking on them
+        std::vector<int> get_event_fds() const;
+
+        // Asks the compositor when to draw the next frame, take_frame() turns true once it is due. Returns false
+        // where the compositor does not pace frames.
+        bool request_frame();
+        bool take_frame();
+#endif
+
+#if defined(USE_X11)
+        // Reads the window back through MIT-SHM, throws when the active backend is not X11
+        capture_image capture();
+        capture_image capture(const rect& area);
+        void set_continuous_capture(bool state);
+        bool is_continuous_capture() const;
+#endif
+
+        template<typename ItT>
+        void poll_events(ItT position_it)
+        {
+            poll_batch();
+
+            std::copy(m_events.cbegin(), m_events.cend(), position_it);
+
+            m_events.clear();
+        }
+
+    private:
+        struct impl;
+
+        std::unique_ptr<impl> m_impl;
+        std::vector<generic_event> m_events;
+
+        void poll_batch();
+    };
+}
\ No newline at end of file
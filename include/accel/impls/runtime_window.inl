@@ -0,0 +1,155 @@
+#include <cstdlib>
+#include <new>
+
+namespace accel
+{
+    enum class window_backends
+    {
+        wayland,
+        x11
+    };
+
+    // Holds whichever backend could be created at startup. Calls go through a switch on the active
+    // backend, poll_events pays for that once per poll and decodes events without any indirection.
+    class runtime_window
+    {
+    public:
+        using command_t = std::function<void(runtime_window&)>;
+
+        // Wayland goes first since it avoids the XWayland hop, X11 is the fallback when it is
+        // not advertised or fails to connect
+        runtime_window(const window_create_params& params)
+        {
+            bool has_x11 = std::getenv("DISPLAY") != nullptr;
+
+            if (std::getenv("WAYLAND_DISPLAY") || !has_x11)
+            {
+                try
+                {
+                    new (&m_wayland) wayland_window(params);
+                    m_backend = window_backends::wayland;
+                    return;
+                }
+                catch (...)
+                {
+                    if (!has_x11)
+                        throw;
+                }
+            }
+
+            new (&m_x11) x11_window(params);
+            m_backend = window_backends::x11;
+        }
+
+        ~runtime_window()
+        {
+            if (m_backend == window_backends::wayland)
+                m_wayland.~wayland_window();
+            else
+                m_x11.~x11_window();
+        }
+
+        runtime_window(const runtime_window&) = delete;
+        runtime_window& operator=(const runtime_window&) = delete;
+
+        window_backends get_backend() const { return m_backend; }
+        wayland_window* get_wayland_window() { return m_backend == window_backends::wayland ? &m_wayland : nullptr; }
+        x11_window* get_x11_window() { return m_backend == window_backends::x11 ? &m_x11 : nullptr; }
+
+#define ACCEL_RUNTIME_WINDOW_DISPATCH(call) \
+        switch (m_backend) \
+        { \
+            case window_backends::wayland: return m_wayland.call; \
+            default: return m_x11.call; \
+        }
+
+        unsigned int get_client_width() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_client_width()) }
+        unsigned int get_client_height() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_client_height()) }
+        unsigned int get_width() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_width()) }
+        unsigned int get_height() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_height()) }
+        int get_x() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_x()) }
+        int get_y() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_y()) }
+
+        bool is_closing() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_closing()) }
+        bool is_resizable() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_resizable()) }
+        bool is_undecorated() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_undecorated()) }
+        bool is_hidden() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_hidden()) }
+        bool is_fullscreen() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_fullscreen()) }
+        bool is_hiding_mouse() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_hiding_mouse()) }
+        bool is_trapping_mouse() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_trapping_mouse()) }
+        flagset<window_style_bits> get_style() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_style()) }
+        flagset<event_types> get_event_subscription() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_event_subscription()) }
+        visibility_states get_visibility() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_visibility()) }
+        bool is_occluded() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_occluded()) }
+        bool is_active() const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_active()) }
+        bool is_key_down(unsigned int keycode) const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_key_down(keycode)) }
+        bool is_button_down(mouse_buttons button) const { ACCEL_RUNTIME_WINDOW_DISPATCH(is_button_down(button)) }
+        input_state get_input_state() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_input_state()) }
+        const window_stats& stats() const { ACCEL_RUNTIME_WINDOW_DISPATCH(stats()) }
+        window_state get_state() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_state()) }
+
+        utf8::string get_title() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_title()) }
+        void set_title(const utf8::string& title) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_title(title)) }
+        void set_position(int x, int y) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_position(x, y)) }
+        void set_size(unsigned int width, unsigned int height) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_size(width, height)) }
+        void set_client_size(unsigned int width, unsigned int height) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_client_size(width, height)) }
+        void set_rect(int x, int y, unsigned int width, unsigned int height) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_rect(x, y, width, height)) }
+        void set_resizable(bool state) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_resizable(state)) }
+        void set_undecorated(bool state) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_undecorated(state)) }
+        void set_hidden(bool state) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_hidden(state)) }
+        void set_fullscreen(bool state, std::uint64_t output_id = 0) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_fullscreen(state, output_id)) }
+        compositor_bypass_states get_bypass_state() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_bypass_state()) }
+        void set_hide_mouse(bool state) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_hide_mouse(state)) }
+        void set_trap_mouse(bool state) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_trap_mouse(state)) }
+        void set_style(const flagset<window_style_bits>& style) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_style(style)) }
+        void set_event_subscription(const flagset<event_types>& events) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_event_subscription(events)) }
+        void retarget(const window_create_params& params) { ACCEL_RUNTIME_WINDOW_DISPATCH(retarget(params)) }
+        void set_render_scale(float scale) { ACCEL_RUNTIME_WINDOW_DISPATCH(set_render_scale(scale)) }
+        float get_render_scale() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_render_scale()) }
+        std::vector<output_info> get_outputs() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_outputs()) }
+        std::vector<std::uint64_t> get_current_outputs() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_current_outputs()) }
+        const std::vector<motion_sample>& get_motion_history() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_motion_history()) }
+        std::vector<int> get_event_fds() const { ACCEL_RUNTIME_WINDOW_DISPATCH(get_event_fds()) }
+        bool request_frame() { ACCEL_RUNTIME_WINDOW_DISPATCH(request_frame()) }
+        bool take_frame() { ACCEL_RUNTIME_WINDOW_DISPATCH(take_frame()) }
+
+        // Capture reads back through MIT-SHM and only exists on X11
+        capture_image capture() { return get_capture_window().capture(); }
+        capture_image capture(const rect& area) { return get_capture_window().capture(area); }
+        void set_continuous_capture(bool state) { get_capture_window().set_continuous_capture(state); }
+        bool is_continuous_capture() const { return m_backend == window_backends::x11 && m_x11.is_continuous_capture(); }
+
+        // Can be called from any thread, the command runs on the owning thread during its next poll_events
+        std::future<void> post(command_t command)
+        {
+            return m_commands.post(std::move(command));
+        }
+
+        template<typename ItT>
+        void poll_events(ItT position_it)
+        {
+            m_commands.apply(*this);
+
+            ACCEL_RUNTIME_WINDOW_DISPATCH(poll_events(position_it))
+        }
+
+#undef ACCEL_RUNTIME_WINDOW_DISPATCH
+
+    private:
+        window_backends m_backend;
+        details::command_queue<runtime_window> m_commands;
+
+        x11_window& get_capture_window()
+        {
+            if (m_backend != window_backends::x11)
+                throw std::runtime_error("Window capture is only available on X11.");
+            return m_x11;
+        }
+
+        union
+        {
+            wayland_window m_wayland;
+            x11_window m_x11;
+        };
+    };
+}
\ No newline at end of file
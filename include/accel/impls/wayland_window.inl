@@ -1,14 +1,24 @@
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <linux/input-event-codes.h>
 
 #include <wayland-client.h>
 #include <xdg-shell.h>
 #include <xdg-decoration.h>
+#include <viewporter.h>
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+#include <fractional-scale.h>
+#endif
+#include <xdg-output.h>
 
 namespace accel
 {
@@ -16,12 +26,48 @@ namespace accel
     {
         // Listener callback declarations
         static void registry_global(void* data, wl_registry* wl_registry, std::uint32_t name, const char* interface, std::uint32_t version);
+        static void registry_global_remove(void* data, wl_registry* wl_registry, std::uint32_t name);
         static void wm_base_ping(void* data, xdg_wm_base* xdg_wm_base, std::uint32_t serial);
         static void surface_configure(void* data, xdg_surface* xdg_surface, std::uint32_t serial);
         static void tl_configure(void* data, xdg_toplevel* xdg_toplevel, std::int32_t width, std::int32_t height, wl_array *states);
         static void tl_close(void* data, xdg_toplevel* xdg_toplevel);
         static void tl_configure_bounds(void* data, xdg_toplevel* xdg_toplevel, std::int32_t width, std::int32_t height);
         static void tl_wm_capabilities(void* data, xdg_toplevel* xdg_toplevel, wl_array* capabilities);
+        static void seat_capabilities(void* data, wl_seat* wl_seat, std::uint32_t capabilities);
+        static void pointer_enter(void* data, wl_pointer* wl_pointer, std::uint32_t serial, wl_surface* surface, wl_fixed_t surface_x, wl_fixed_t surface_y);
+        static void pointer_leave(void* data, wl_pointer* wl_pointer, std::uint32_t serial, wl_surface* surface);
+        static void pointer_motion(void* data, wl_pointer* wl_pointer, std::uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y);
+        static void pointer_button(void* data, wl_pointer* wl_pointer, std::uint32_t serial, std::uint32_t time, std::uint32_t button, std::uint32_t state);
+        static void pointer_axis(void* data, wl_pointer* wl_pointer, std::uint32_t time, std::uint32_t axis, wl_fixed_t value);
+        static void pointer_frame(void* data, wl_pointer* wl_pointer);
+        static void pointer_axis_discrete(void* data, wl_pointer* wl_pointer, std::uint32_t axis, std::int32_t discrete);
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+        static void pointer_axis_value120(void* data, wl_pointer* wl_pointer, std::uint32_t axis, std::int32_t value120);
+#endif
+        static void touch_down(void* data, wl_touch* wl_touch, std::uint32_t serial, std::uint32_t time, wl_surface* surface, std::int32_t id, wl_fixed_t x, wl_fixed_t y);
+        static void touch_up(void* data, wl_touch* wl_touch, std::uint32_t serial, std::uint32_t time, std::int32_t id);
+        static void touch_motion(void* data, wl_touch* wl_touch, std::uint32_t time, std::int32_t id, wl_fixed_t x, wl_fixed_t y);
+        static void touch_frame(void* data, wl_touch* wl_touch);
+        static void touch_cancel(void* data, wl_touch* wl_touch);
+        static void keyboard_enter(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, wl_surface* surface, wl_array* keys);
+        static void keyboard_leave(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, wl_surface* surface);
+        static void keyboard_key(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, std::uint32_t time, std::uint32_t key, std::uint32_t state);
+        static void keyboard_repeat_info(void* data, wl_keyboard* wl_keyboard, std::int32_t rate, std::int32_t delay);
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+        static void fractional_scale_preferred(void* data, wp_fractional_scale_v1* wp_fractional_scale_v1, std::uint32_t scale);
+#endif
+        static void surface_enter(void* data, wl_surface* wl_surface, wl_output* output);
+        static void surface_leave(void* data, wl_surface* wl_surface, wl_output* output);
+        static void surface_frame_done(void* data, wl_callback* wl_callback, std::uint32_t time);
+        static void output_geometry(void* data, wl_output* wl_output, std::int32_t x, std::int32_t y, std::int32_t physical_width, std::int32_t physical_height, std::int32_t subpixel, const char* make, const char* model, std::int32_t transform);
+        static void output_mode(void* data, wl_output* wl_output, std::uint32_t flags, std::int32_t width, std::int32_t height, std::int32_t refresh);
+        static void output_done(void* data, wl_output* wl_output);
+        static void output_scale(void* data, wl_output* wl_output, std::int32_t factor);
+        static void output_name(void* data, wl_output* wl_output, const char* name);
+        static void xdg_output_logical_position(void* data, zxdg_output_v1* zxdg_output_v1, std::int32_t x, std::int32_t y);
+        static void xdg_output_logical_size(void* data, zxdg_output_v1* zxdg_output_v1, std::int32_t width, std::int32_t height);
+        static void xdg_output_done(void* data, zxdg_output_v1* zxdg_output_v1);
+        static void xdg_output_name(void* data, zxdg_output_v1* zxdg_output_v1, const char* name);
 
 
         // Definitions for simple callbacks 
@@ -35,7 +81,23 @@ namespace accel
             xdg_wm_base_pong(xdg_wm_base, serial);
         }
 
-        static void registry_global_remove(void* data, wl_registry* registry, std::uint32_t name) {}
+        static void seat_name(void* data, wl_seat* wl_seat, const char* name) {}
+
+        static void pointer_axis_source(void* data, wl_pointer* wl_pointer, std::uint32_t axis_source) {}
+        static void pointer_axis_stop(void* data, wl_pointer* wl_pointer, std::uint32_t time, std::uint32_t axis) {}
+
+        static void touch_shape(void* data, wl_touch* wl_touch, std::int32_t id, wl_fixed_t major, wl_fixed_t minor) {}
+        static void touch_orientation(void* data, wl_touch* wl_touch, std::int32_t id, wl_fixed_t orientation) {}
+
+        static void keyboard_keymap(void* data, wl_keyboard* wl_keyboard, std::uint32_t format, std::int32_t fd, std::uint32_t size)
+        {
+            close(fd);
+        }
+
+        static void keyboard_modifiers(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, std::uint32_t mods_depressed, std::uint32_t mods_latched, std::uint32_t mods_locked, std::uint32_t group) {}
+
+        static void output_description(void* data, wl_output* wl_output, const char* description) {}
+        static void xdg_output_description(void* data, zxdg_output_v1* zxdg_output_v1, const char* description) {}
 
 
         // Listeners
@@ -46,6 +108,69 @@ namespace accel
         static xdg_surface_listener surface_listener { &surface_configure };
         static xdg_toplevel_listener toplevel_listener { &tl_configure, &tl_close, &tl_configure_bounds, &tl_wm_capabilities };
 
+        // The seat is bound at version 8 at most when the headers know axis_value120, 5 otherwise,
+        // so these cover every event the compositor can send
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+        static const std::uint32_t max_seat_version = 8;
+        static wl_seat_listener seat_listener { &seat_capabilities, &seat_name };
+        static wl_pointer_listener pointer_listener { &pointer_enter, &pointer_leave, &pointer_motion, &pointer_button, &pointer_axis, &pointer_frame, &pointer_axis_source, &pointer_axis_stop, &pointer_axis_discrete, &pointer_axis_value120 };
+        static wl_touch_listener touch_listener { &touch_down, &touch_up, &touch_motion, &touch_frame, &touch_cancel, &touch_shape, &touch_orientation };
+#else
+        static const std::uint32_t max_seat_version = 5;
+        static wl_seat_listener seat_listener { &seat_capabilities, &seat_name };
+        static wl_pointer_listener pointer_listener { &pointer_enter, &pointer_leave, &pointer_motion, &pointer_button, &pointer_axis, &pointer_frame, &pointer_axis_source, &pointer_axis_stop, &pointer_axis_discrete };
+        static wl_touch_listener touch_listener { &touch_down, &touch_up, &touch_motion, &touch_frame, &touch_cancel };
+#endif
+        static wl_keyboard_listener keyboard_listener { &keyboard_keymap, &keyboard_enter, &keyboard_leave, &keyboard_key, &keyboard_modifiers, &keyboard_repeat_info };
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+        static wp_fractional_scale_v1_listener fractional_scale_listener { &fractional_scale_preferred };
+#endif
+
+        // The compositor is bound at version 4 at most so surfaces never send the version 6 events
+        static const std::uint32_t max_compositor_version = 4;
+        static wl_surface_listener surface_output_listener { &surface_enter, &surface_leave };
+        static wl_callback_listener frame_listener { &surface_frame_done };
+
+        static const std::uint32_t max_output_version = 4;
+        static const std::uint32_t max_xdg_output_manager_version = 3;
+        static wl_output_listener output_listener { &output_geometry, &output_mode, &output_done, &output_scale, &output_name, &output_description };
+        static zxdg_output_v1_listener xdg_output_listener { &xdg_output_logical_position, &xdg_output_logical_size, &xdg_output_done, &xdg_output_name, &xdg_output_description };
+
+        static bool from_linux_button(std::uint32_t linux_button, mouse_buttons& button)
+        {
+            switch (linux_button)
+            {
+                case BTN_LEFT: button = mouse_buttons::left; return true;
+                case BTN_MIDDLE: button = mouse_buttons::middle; return true;
+                case BTN_RIGHT: button = mouse_buttons::right; return true;
+                case BTN_SIDE: button = mouse_buttons::backwards; return true;
+                case BTN_EXTRA: button = mouse_buttons::forwards; return true;
+                default: return false;
+            }
+        }
+
+        // Evdev codes are offset by 8 to match the XKB keycodes reported by the X11 backend
+        static unsigned int from_evdev_key(std::uint32_t evdev_key)
+        {
+            return static_cast<unsigned int>(evdev_key + 8);
+        }
+
+        // The keymap is never parsed, so the modifiers and locks that XKB marks as non-repeating are listed by hand
+        static bool is_repeating_key(std::uint32_t evdev_key)
+        {
+            switch (evdev_key)
+            {
+                case KEY_LEFTCTRL: case KEY_RIGHTCTRL:
+                case KEY_LEFTSHIFT: case KEY_RIGHTSHIFT:
+                case KEY_LEFTALT: case KEY_RIGHTALT:
+                case KEY_LEFTMETA: case KEY_RIGHTMETA:
+                case KEY_CAPSLOCK: case KEY_NUMLOCK: case KEY_SCROLLLOCK:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
         struct shared_memory
         {
             std::string name;
@@ -86,6 +211,57 @@ namespace accel
             }
         };
 
+        struct wayland_state;
+
+        // Properties of an output arrive as a burst closed by done, they are only reported from there
+        struct wayland_output
+        {
+            wayland_state* state;
+            std::uint32_t global_name;
+            wl_output* output;
+            zxdg_output_v1* xdg_output;
+            output_info info;
+            output_info pending;
+            std::int32_t transform;
+            std::int32_t mode_width;
+            std::int32_t mode_height;
+            std::int32_t logical_width;
+            std::int32_t logical_height;
+            bool announced;
+
+            wayland_output(wayland_state* state, std::uint32_t global_name, wl_output* output) :
+                state(state),
+                global_name(global_name),
+                output(output),
+                xdg_output(nullptr),
+                info(),
+                pending(),
+                transform(WL_OUTPUT_TRANSFORM_NORMAL),
+                mode_width(0),
+                mode_height(0),
+                logical_width(0),
+                logical_height(0),
+                announced(false)
+            {
+                pending.id = global_name;
+                pending.scale = 1.0f;
+            }
+
+            ~wayland_output()
+            {
+                if (xdg_output)
+                    zxdg_output_v1_destroy(xdg_output);
+
+                if (wl_output_get_version(output) >= WL_OUTPUT_RELEASE_SINCE_VERSION)
+                    wl_output_release(output);
+                else
+                    wl_output_destroy(output);
+            }
+
+            wayland_output(const wayland_output&) = delete;
+            wayland_output& operator=(const wayland_output&) = delete;
+        };
+
         struct wayland_state
         {
             // Objects
@@ -94,6 +270,13 @@ namespace accel
             xdg_surface* xdg_surf;
             xdg_toplevel* top_level;
             zxdg_toplevel_decoration_v1* decoration;
+            wl_pointer* pointer;
+            wl_keyboard* keyboard;
+            wl_touch* touch;
+            wp_viewport* viewport;
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+            wp_fractional_scale_v1* fractional_scale;
+#endif
             
             // Globals
             wl_display* display;
@@ -103,6 +286,12 @@ namespace accel
             wl_shm* shm;
             xdg_wm_base* wm_base;
             zxdg_decoration_manager_v1* decoration_manager;
+            wp_viewporter* viewporter;
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+            wp_fractional_scale_manager_v1* fractional_scale_manager;
+#endif
+            zxdg_output_manager_v1* xdg_output_manager;
+            std::vector<std::unique_ptr<wayland_output>> outputs;
 
             // Callbacks
             std::function<void()> configure;
@@ -110,10 +299,52 @@ namespace accel
             // Variables
             bool is_closing;
             bool seen_first_config;
+            bool needs_initial_commit;
+            bool batching;
+            bool flush_pending;
+            bool hidden;
+            bool hide_cursor;
+            bool fullscreen;
             std::int32_t width;
             std::int32_t height;
+            std::int32_t pending_width;
+            std::int32_t pending_height;
+            std::int32_t buffer_width;
+            std::int32_t buffer_height;
+            float render_scale;
+            float scale;
+            int pointer_x;
+            int pointer_y;
+            std::uint32_t pointer_serial;
+            double pending_axis[2];
+            std::int32_t pending_axis120[2];
+            scroll_accumulator scroll;
+            std::vector<touch_point> touches;
+            std::vector<motion_sample> motion_history;
+            touch_accumulator touch_points;
+            std::uint32_t seat_caps;
 
-            wayland_state(std::int32_t width, std::int32_t height) :
+            // Key repeat is up to the client. A timerfd next to the display fd fires at the compositor's
+            // rate and delay, so apps blocking on the display should wait on repeat_fd as well.
+            int repeat_fd;
+            std::int32_t repeat_rate;
+            std::int32_t repeat_delay;
+            unsigned int repeat_key;
+            bool repeating;
+
+            // Pending wl_surface.frame request, frame_due is set once the compositor wants the next frame drawn
+            wl_callback* frame_callback;
+            bool frame_due;
+            visibility_states visibility;
+            bool active;
+            flagset<event_types> subscription;
+            input_state input;
+            std::vector<generic_event> events;
+            window_stats stats;
+            seqlock<window_state> published;
+            std::vector<std::uint64_t> current_outputs;
+
+            wayland_state(std::int32_t width, std::int32_t height, const flagset<event_types>& subscription, bool hidden) :
                 display(nullptr),
                 registry(nullptr),
                 compositor(nullptr),
@@ -121,15 +352,58 @@ namespace accel
                 shm(nullptr),
                 wm_base(nullptr),
                 decoration_manager(nullptr),
+                viewporter(nullptr),
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+                fractional_scale_manager(nullptr),
+#endif
+                xdg_output_manager(nullptr),
                 surf(nullptr),
                 xdg_surf(nullptr),
                 top_level(nullptr),
                 decoration(nullptr),
+                pointer(nullptr),
+                keyboard(nullptr),
+                touch(nullptr),
+                viewport(nullptr),
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+                fractional_scale(nullptr),
+#endif
                 is_closing(false),
                 seen_first_config(false),
+                needs_initial_commit(true),
+                batching(false),
+                flush_pending(false),
+                hidden(hidden),
+                hide_cursor(false),
+                fullscreen(false),
                 width(width),
-                height(height)
+                height(height),
+                pending_width(0),
+                pending_height(0),
+                buffer_width(0),
+                buffer_height(0),
+                render_scale(1.0f),
+                scale(1.0f),
+                pointer_x(0),
+                pointer_y(0),
+                pointer_serial(0),
+                pending_axis(),
+                pending_axis120(),
+                seat_caps(0),
+                repeat_fd(-1),
+                repeat_rate(25),
+                repeat_delay(600),
+                repeat_key(0),
+                repeating(false),
+                frame_callback(nullptr),
+                frame_due(false),
+                visibility(visibility_states::visible),
+                active(false),
+                subscription(subscription),
+                published(window_state{ static_cast<unsigned int>(width), static_cast<unsigned int>(height), 1.0f, false, visibility_states::visible })
             {
+                ACCEL_WINDOW_TRACE_SCOPE("wayland_window::wayland_state");
+
                 display = wl_display_connect(nullptr);
                 if (!display)
                     throw std::runtime_error("Failed to connect to Wayland display.");
@@ -140,6 +414,7 @@ namespace accel
 
                 wl_registry_add_listener(registry, &registry_listener, this);
                 wl_display_roundtrip(display);
+                window_stats::add(stats.round_trips);
 
                 if (!compositor || !seat || !shm || !decoration_manager || !wm_base)
                     throw std::runtime_error("Failed to bind all the necessary globals from the registry.");
@@ -148,6 +423,8 @@ namespace accel
                 if (!surf)
                     throw std::runtime_error("Compositor failed to create surface.");
 
+                wl_surface_add_listener(surf, &surface_output_listener, this);
+
                 xdg_surf = xdg_wm_base_get_xdg_surface(wm_base, surf);
                 if (!xdg_surf)
                     throw std::runtime_error("Failed to get XDG surface.");
@@ -164,19 +441,58 @@ namespace accel
                 if (!decoration)
                     throw std::runtime_error("Failed to get XDG top level decoration.");
 
-                resize_surface(width, height);
+                // Both are optional, without them buffers are drawn at the client size
+                if (viewporter)
+                    viewport = wp_viewporter_get_viewport(viewporter, surf);
 
-                while (!seen_first_config) 
-                    wl_display_dispatch(display);
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+                // Created before the initial commit so the preferred scale is known by the first configure
+                if (fractional_scale_manager)
+                {
+                    fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(fractional_scale_manager, surf);
+                    wp_fractional_scale_v1_add_listener(fractional_scale, &fractional_scale_listener, this);
+                }
+#endif
+
+                // Hidden windows get their configure while they wait, showing them later is a single commit
+                if (hidden)
+                    request_configure();
+                else
+                    map();
+
+                // Without a timer keys simply do not repeat
+                repeat_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
             }
 
             ~wayland_state()
             {
+                release_pointer();
+                release_keyboard();
+                release_touch();
+                if (repeat_fd >= 0)
+                    close(repeat_fd);
+                if (frame_callback)
+                    wl_callback_destroy(frame_callback);
                 memory.reset();
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+                if (fractional_scale)
+                    wp_fractional_scale_v1_destroy(fractional_scale);
+#endif
+                if (viewport)
+                    wp_viewport_destroy(viewport);
                 xdg_toplevel_destroy(top_level);
                 xdg_surface_destroy(xdg_surf);
                 wl_surface_destroy(surf);
+                outputs.clear();
+                if (xdg_output_manager)
+                    zxdg_output_manager_v1_destroy(xdg_output_manager);
                 zxdg_decoration_manager_v1_destroy(decoration_manager);
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+                if (fractional_scale_manager)
+                    wp_fractional_scale_manager_v1_destroy(fractional_scale_manager);
+#endif
+                if (viewporter)
+                    wp_viewporter_destroy(viewporter);
                 xdg_wm_base_destroy(wm_base);
                 wl_shm_destroy(shm);
                 wl_seat_release(seat);
@@ -187,21 +503,392 @@ namespace accel
         
             void resize_surface(std::int32_t new_width, std::int32_t new_height)
             {
-                std::size_t stride = new_width * 4;
-                std::size_t size = stride * new_height;
+                ACCEL_WINDOW_TRACE_SCOPE("wayland_window::resize_surface");
+
+                // With a render scale the buffer differs from the client size and the viewport stretches it back
+                buffer_width = get_scaled(new_width);
+                buffer_height = get_scaled(new_height);
+
+                std::size_t stride = buffer_width * 4;
+                std::size_t size = stride * buffer_height;
 
                 memory.reset(new shared_memory(shm, size));
+                window_stats::add(stats.shm_bytes, size);
 
-                wl_buffer* buffer = wl_shm_pool_create_buffer(memory->pool, 0, new_width, new_height, stride, WL_SHM_FORMAT_XRGB8888);
+                wl_buffer* buffer = wl_shm_pool_create_buffer(memory->pool, 0, buffer_width, buffer_height, stride, WL_SHM_FORMAT_XRGB8888);
                 if (!buffer)
                     throw std::runtime_error("Failed to create buffer from pool.");
                 wl_buffer_add_listener(buffer, &details::buffer_listener, NULL);
 
+                if (viewport)
+                    wp_viewport_set_destination(viewport, new_width, new_height);
+
                 wl_surface_attach(surf, buffer, 0, 0);
                 wl_surface_commit(surf);
 
+                bool resized = new_width != width || new_height != height;
                 width = new_width;
                 height = new_height;
+
+                if (resized)
+                {
+                    unsigned int client_width = static_cast<unsigned int>(new_width);
+                    unsigned int client_height = static_cast<unsigned int>(new_height);
+                    emit(resize_event{ client_width, client_height, client_width, client_height });
+                    publish();
+                }
+
+                // A fresh buffer has no contents, everything needs to be drawn again
+                expose_event expose{};
+                expose.count = 1;
+                expose.rects[0] = rect{ 0, 0, static_cast<unsigned int>(new_width), static_cast<unsigned int>(new_height) };
+                emit(expose_event(expose));
+            }
+
+            std::int32_t get_scaled(std::int32_t size) const
+            {
+                return std::max<std::int32_t>(1, static_cast<std::int32_t>(std::lround(size * render_scale)));
+            }
+
+            // Axis events of one pointer frame make up a single scroll. Wheel clicks in 120ths of a notch
+            // take precedence over the continuous value, which compositors scale to about 10 per notch.
+            void commit_axis()
+            {
+                float delta[2];
+                for (int i = 0; i < 2; i++)
+                {
+                    delta[i] = pending_axis120[i] != 0 ? pending_axis120[i] / 120.0f : static_cast<float>(pending_axis[i] / 10.0);
+                    pending_axis[i] = 0.0;
+                    pending_axis120[i] = 0;
+                }
+
+                // Axis values grow down and right
+                scroll.add(pointer_x, pointer_y, delta[WL_POINTER_AXIS_HORIZONTAL_SCROLL], -delta[WL_POINTER_AXIS_VERTICAL_SCROLL]);
+            }
+
+            void emit(generic_event&& event)
+            {
+                bool subscribed = subscription[event.type];
+                stats.add_event(event.type, !subscribed);
+
+                if (subscribed)
+                    events.emplace_back(std::move(event));
+            }
+
+            void flush()
+            {
+                if (batching)
+                {
+                    flush_pending = true;
+                    return;
+                }
+
+                flush_pending = false;
+                wl_display_flush(display);
+                window_stats::add(stats.flushes);
+            }
+
+            // Buffers may only be attached once the surface has been configured, which takes an
+            // initial commit without one after creation or after being unmapped
+            void request_configure()
+            {
+                seen_first_config = false;
+                wl_surface_commit(surf);
+                needs_initial_commit = false;
+            }
+
+            void map()
+            {
+                hidden = false;
+
+                if (needs_initial_commit)
+                    request_configure();
+
+                // Blocks until the compositor answers just like a round trip, unless the configure
+                // already arrived while the window was hidden
+                if (!seen_first_config)
+                {
+                    while (!seen_first_config) 
+                        wl_display_dispatch(display);
+                    window_stats::add(stats.round_trips);
+                }
+
+                // A configure that arrived while hidden may carry a maximized, tiled or fullscreen size, which the
+                // buffer has to match. Zero leaves the choice to us, the same as in surface_configure.
+                if (!memory)
+                    resize_surface(pending_width > 0 ? pending_width : width, pending_height > 0 ? pending_height : height);
+            }
+
+            void unmap()
+            {
+                hidden = true;
+                fullscreen = false;
+
+                wl_surface_attach(surf, nullptr, 0, 0);
+                wl_surface_commit(surf);
+                memory.reset();
+
+                request_configure();
+            }
+
+            void publish()
+            {
+                published.store(window_state{ static_cast<unsigned int>(width), static_cast<unsigned int>(height), scale, active, visibility });
+            }
+
+            void set_visibility(visibility_states new_visibility)
+            {
+                if (new_visibility == visibility)
+                    return;
+
+                visibility = new_visibility;
+                emit(visibility_event{ new_visibility });
+                publish();
+            }
+
+            void set_active(bool new_active)
+            {
+                if (new_active == active)
+                    return;
+
+                active = new_active;
+                emit(activate_event{ new_active });
+                publish();
+            }
+
+            // xdg_output reports the logical layout, which may only be known after every wl_output got bound
+            void attach_xdg_output(wayland_output& output)
+            {
+                if (!xdg_output_manager || output.xdg_output)
+                    return;
+
+                output.xdg_output = zxdg_output_manager_v1_get_xdg_output(xdg_output_manager, output.output);
+                zxdg_output_v1_add_listener(output.xdg_output, &xdg_output_listener, &output);
+            }
+
+            wayland_output* find_output(wl_output* output)
+            {
+                for (const std::unique_ptr<wayland_output>& current : outputs)
+                {
+                    if (current->output == output)
+                        return current.get();
+                }
+                return nullptr;
+            }
+
+            void set_current_output(std::uint64_t id, bool current)
+            {
+                auto it = std::find(current_outputs.begin(), current_outputs.end(), id);
+                if (current && it == current_outputs.end())
+                {
+                    current_outputs.push_back(id);
+                    emit(output_event{ output_changes::entered, id });
+                }
+                else if (!current && it != current_outputs.end())
+                {
+                    current_outputs.erase(it);
+                    emit(output_event{ output_changes::left, id });
+                }
+            }
+
+            // Without xdg_output the logical size is derived from the current mode and the integer scale.
+            // With it the fractional scale is the ratio between the two.
+            void commit_output(wayland_output& output)
+            {
+                std::int32_t mode_width = output.mode_width;
+                std::int32_t mode_height = output.mode_height;
+                if (output.transform % 2 != 0)
+                    std::swap(mode_width, mode_height);
+
+                output_info& pending = output.pending;
+                if (output.logical_width > 0 && output.logical_height > 0)
+                {
+                    pending.width = static_cast<unsigned int>(output.logical_width);
+                    pending.height = static_cast<unsigned int>(output.logical_height);
+                    if (mode_width > 0)
+                        pending.scale = static_cast<float>(mode_width) / static_cast<float>(output.logical_width);
+                }
+                else
+                {
+                    pending.width = static_cast<unsigned int>(mode_width / std::max(1, static_cast<int>(pending.scale)));
+                    pending.height = static_cast<unsigned int>(mode_height / std::max(1, static_cast<int>(pending.scale)));
+                }
+
+                bool changed = !is_same_output(output.info, pending);
+                output.info = pending;
+
+                if (!output.announced)
+                {
+                    output.announced = true;
+                    emit(output_event{ output_changes::added, output.info.id });
+                }
+                else if (changed)
+                {
+                    emit(output_event{ output_changes::changed, output.info.id });
+                }
+            }
+
+            void remove_output(std::uint32_t global_name)
+            {
+                for (auto it = outputs.begin(); it != outputs.end(); ++it)
+                {
+                    if ((*it)->global_name != global_name)
+                        continue;
+
+                    set_current_output(global_name, false);
+                    if ((*it)->announced)
+                        emit(output_event{ output_changes::removed, global_name });
+
+                    outputs.erase(it);
+                    return;
+                }
+            }
+
+            // Only ask the compositor for the input devices whose events are subscribed to
+            void update_input_devices()
+            {
+                bool wants_pointer = subscription[event_types::mouse_down] || subscription[event_types::mouse_up] || 
+                    subscription[event_types::mouse_move] || subscription[event_types::mouse_scroll];
+                bool wants_keyboard = subscription[event_types::key_down] || subscription[event_types::key_up];
+                bool wants_touch = subscription[event_types::touch];
+
+                if (wants_pointer && (seat_caps & WL_SEAT_CAPABILITY_POINTER))
+                {
+                    if (!pointer)
+                    {
+                        pointer = wl_seat_get_pointer(seat);
+                        wl_pointer_add_listener(pointer, &pointer_listener, this);
+                    }
+                }
+                else
+                {
+                    release_pointer();
+                }
+
+                if (wants_keyboard && (seat_caps & WL_SEAT_CAPABILITY_KEYBOARD))
+                {
+                    if (!keyboard)
+                    {
+                        keyboard = wl_seat_get_keyboard(seat);
+                        wl_keyboard_add_listener(keyboard, &keyboard_listener, this);
+                    }
+                }
+                else
+                {
+                    release_keyboard();
+                }
+
+                if (wants_touch && (seat_caps & WL_SEAT_CAPABILITY_TOUCH))
+                {
+                    if (!touch)
+                    {
+                        touch = wl_seat_get_touch(seat);
+                        wl_touch_add_listener(touch, &touch_listener, this);
+                    }
+                }
+                else
+                {
+                    release_touch();
+                }
+            }
+
+            void release_pointer()
+            {
+                if (!pointer)
+                    return;
+
+                if (wl_pointer_get_version(pointer) >= WL_POINTER_RELEASE_SINCE_VERSION)
+                    wl_pointer_release(pointer);
+                else
+                    wl_pointer_destroy(pointer);
+                pointer = nullptr;
+            }
+
+            void release_keyboard()
+            {
+                if (!keyboard)
+                    return;
+
+                if (wl_keyboard_get_version(keyboard) >= WL_KEYBOARD_RELEASE_SINCE_VERSION)
+                    wl_keyboard_release(keyboard);
+                else
+                    wl_keyboard_destroy(keyboard);
+                keyboard = nullptr;
+                stop_key_repeat();
+            }
+
+            void start_key_repeat(unsigned int keycode)
+            {
+                if (repeat_fd < 0 || repeat_rate <= 0)
+                    return;
+
+                // A zero it_value would disarm the timer, no delay means the first repeat comes after one interval
+                long interval_ns = 1000000000L / repeat_rate;
+                long delay_ns = repeat_delay > 0 ? repeat_delay * 1000000L : interval_ns;
+
+                itimerspec spec;
+                spec.it_value.tv_sec = delay_ns / 1000000000L;
+                spec.it_value.tv_nsec = delay_ns % 1000000000L;
+                spec.it_interval.tv_sec = interval_ns / 1000000000L;
+                spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+                timerfd_settime(repeat_fd, 0, &spec, nullptr);
+
+                repeat_key = keycode;
+                repeating = true;
+            }
+
+            // Repeats that came due before the stop are still delivered, disarming then drops any count left
+            void stop_key_repeat()
+            {
+                if (!repeating)
+                    return;
+
+                emit_key_repeats();
+
+                itimerspec spec = {};
+                timerfd_settime(repeat_fd, 0, &spec, nullptr);
+                repeating = false;
+            }
+
+            // The timer counts every interval that passed since the last read, so late polls catch up without drift
+            void emit_key_repeats()
+            {
+                if (!repeating)
+                    return;
+
+                std::uint64_t expirations = 0;
+                if (read(repeat_fd, &expirations, sizeof(expirations)) != static_cast<ssize_t>(sizeof(expirations)))
+                    return;
+
+                for (std::uint64_t i = 0; i < expirations; i++)
+                    emit(key_down_event{ repeat_key, true });
+            }
+
+            void release_touch()
+            {
+                if (!touch)
+                    return;
+
+                if (wl_touch_get_version(touch) >= WL_TOUCH_RELEASE_SINCE_VERSION)
+                    wl_touch_release(touch);
+                else
+                    wl_touch_destroy(touch);
+                touch = nullptr;
+                touches.clear();
+                touch_points.take();
+            }
+
+            void add_touch(std::int32_t id, touch_phases phase, float x, float y)
+            {
+                if (touch_points.full())
+                    emit_touch();
+                touch_points.add(id, phase, x, y);
+            }
+
+            void emit_touch()
+            {
+                window_stats::add(stats.events_coalesced, touch_points.coalesced());
+                emit(touch_points.take());
             }
 
         };
@@ -215,11 +902,12 @@ namespace accel
 
             if (interface_name == wl_compositor_interface.name)
             {
-                state->compositor = static_cast<wl_compositor*>(wl_registry_bind(wl_registry, name, &wl_compositor_interface, version));
+                state->compositor = static_cast<wl_compositor*>(wl_registry_bind(wl_registry, name, &wl_compositor_interface, std::min(version, max_compositor_version)));
             }
             else if (interface_name == wl_seat_interface.name)
             {
-                state->seat = static_cast<wl_seat*>(wl_registry_bind(wl_registry, name, &wl_seat_interface, version));
+                state->seat = static_cast<wl_seat*>(wl_registry_bind(wl_registry, name, &wl_seat_interface, std::min(version, max_seat_version)));
+                wl_seat_add_listener(state->seat, &seat_listener, state);
             }
             else if (interface_name == wl_shm_interface.name)
             {
@@ -234,6 +922,35 @@ namespace accel
             {
                 state->decoration_manager = static_cast<zxdg_decoration_manager_v1*>(wl_registry_bind(wl_registry, name, &zxdg_decoration_manager_v1_interface, version));
             }
+            else if (interface_name == wp_viewporter_interface.name)
+            {
+                state->viewporter = static_cast<wp_viewporter*>(wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1));
+            }
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+            else if (interface_name == wp_fractional_scale_manager_v1_interface.name)
+            {
+                state->fractional_scale_manager = static_cast<wp_fractional_scale_manager_v1*>(wl_registry_bind(wl_registry, name, &wp_fractional_scale_manager_v1_interface, 1));
+            }
+#endif
+            else if (interface_name == wl_output_interface.name)
+            {
+                auto output = static_cast<wl_output*>(wl_registry_bind(wl_registry, name, &wl_output_interface, std::min(version, max_output_version)));
+                state->outputs.emplace_back(new wayland_output(state, name, output));
+                wl_output_add_listener(output, &output_listener, state->outputs.back().get());
+                state->attach_xdg_output(*state->outputs.back());
+            }
+            else if (interface_name == zxdg_output_manager_v1_interface.name)
+            {
+                state->xdg_output_manager = static_cast<zxdg_output_manager_v1*>(wl_registry_bind(wl_registry, name, &zxdg_output_manager_v1_interface, std::min(version, max_xdg_output_manager_version)));
+                for (const std::unique_ptr<wayland_output>& output : state->outputs)
+                    state->attach_xdg_output(*output);
+            }
+        }
+
+        static void registry_global_remove(void* data, wl_registry* wl_registry, std::uint32_t name)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            state->remove_output(name);
         }
     
         static void surface_configure(void* data, xdg_surface* xdg_surface, std::uint32_t serial)
@@ -244,15 +961,49 @@ namespace accel
                 state->seen_first_config = true;
 
             xdg_surface_ack_configure(xdg_surface, serial);
+
+            // A zero size from the compositor leaves the choice to us
+            std::int32_t new_width = state->pending_width > 0 ? state->pending_width : state->width;
+            std::int32_t new_height = state->pending_height > 0 ? state->pending_height : state->height;
+
+            if (!state->hidden && (!state->memory || new_width != state->width || new_height != state->height))
+                state->resize_surface(new_width, new_height);
         }
 
         static void tl_configure(void* data, xdg_toplevel* xdg_toplevel, std::int32_t width, std::int32_t height, wl_array *states)
         {
-            if (width <= 0 || height <= 0)
-                return;
-            
+            ACCEL_WINDOW_TRACE_SCOPE("wayland_window::tl_configure");
+
             auto state = static_cast<wayland_state*>(data);
-            state->resize_surface(width, height);
+
+            bool active = false;
+            bool suspended = false;
+            bool fullscreen = false;
+
+            std::uint32_t* toplevel_state = static_cast<std::uint32_t*>(states->data);
+            std::uint32_t* end = toplevel_state + states->size / sizeof(std::uint32_t);
+            for (; toplevel_state != end; ++toplevel_state)
+            {
+                if (*toplevel_state == XDG_TOPLEVEL_STATE_ACTIVATED)
+                    active = true;
+                else if (*toplevel_state == XDG_TOPLEVEL_STATE_FULLSCREEN)
+                    fullscreen = true;
+#ifdef XDG_TOPLEVEL_STATE_SUSPENDED_SINCE_VERSION
+                else if (*toplevel_state == XDG_TOPLEVEL_STATE_SUSPENDED)
+                    suspended = true;
+#endif
+            }
+
+            // Wayland does not report occlusion, a suspended toplevel is the closest equivalent
+            state->set_active(active);
+            state->set_visibility(suspended ? visibility_states::suspended : visibility_states::visible);
+
+            // The fullscreen request only takes effect once the compositor configures the toplevel with it
+            state->fullscreen = fullscreen;
+
+            // Applied once the whole configure sequence arrives in surface_configure
+            state->pending_width = width;
+            state->pending_height = height;
         }
 
         static void tl_close(void* data, xdg_toplevel* xdg_toplevel)
@@ -268,41 +1019,675 @@ namespace accel
         static void tl_wm_capabilities(void* data, xdg_toplevel* xdg_toplevel, wl_array* capabilities)
         {
         }
-    }
 
-    using native_handle_t = details::wayland_state&;
+        static void seat_capabilities(void* data, wl_seat* wl_seat, std::uint32_t capabilities)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            state->seat_caps = capabilities;
+            state->update_input_devices();
+        }
+
+        static void pointer_enter(void* data, wl_pointer* wl_pointer, std::uint32_t serial, wl_surface* surface, wl_fixed_t surface_x, wl_fixed_t surface_y)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            state->pointer_x = wl_fixed_to_int(surface_x);
+            state->pointer_y = wl_fixed_to_int(surface_y);
+            state->pointer_serial = serial;
+
+            if (state->hide_cursor)
+                wl_pointer_set_cursor(wl_pointer, serial, nullptr, 0, 0);
+        }
+
+        static void pointer_leave(void* data, wl_pointer* wl_pointer, std::uint32_t serial, wl_surface* surface)
+        {
+            // Releases that happen outside the surface are never delivered to us
+            auto state = static_cast<wayland_state*>(data);
+            state->input.buttons = 0;
+        }
+
+        static void pointer_motion(void* data, wl_pointer* wl_pointer, std::uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            state->pointer_x = wl_fixed_to_int(surface_x);
+            state->pointer_y = wl_fixed_to_int(surface_y);
+            state->motion_history.push_back(motion_sample{ time, static_cast<float>(wl_fixed_to_double(surface_x)), static_cast<float>(wl_fixed_to_double(surface_y)) });
+            state->emit(mouse_move_event{ state->pointer_x, state->pointer_y });
+        }
+
+        static void pointer_button(void* data, wl_pointer* wl_pointer, std::uint32_t serial, std::uint32_t time, std::uint32_t button, std::uint32_t button_state)
+        {
+            auto state = static_cast<wayland_state*>(data);
+
+            mouse_buttons mouse_button;
+            if (!from_linux_button(button, mouse_button))
+                return;
+
+            bool is_down = button_state == WL_POINTER_BUTTON_STATE_PRESSED;
+            state->input.set_button(mouse_button, is_down);
+
+            if (is_down)
+                state->emit(mouse_down_event{ mouse_button, state->pointer_x, state->pointer_y });
+            else
+                state->emit(mouse_up_event{ mouse_button, state->pointer_x, state->pointer_y });
+        }
+
+        static void pointer_axis(void* data, wl_pointer* wl_pointer, std::uint32_t time, std::uint32_t axis, wl_fixed_t value)
+        {
+            if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+                return;
+
+            auto state = static_cast<wayland_state*>(data);
+            state->pending_axis[axis] += wl_fixed_to_double(value);
+
+            // Pointers older than version 5 have no frame event to wait for
+            if (wl_pointer_get_version(wl_pointer) < WL_POINTER_FRAME_SINCE_VERSION)
+                state->commit_axis();
+        }
+
+        static void pointer_frame(void* data, wl_pointer* wl_pointer)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            state->commit_axis();
+        }
+
+        // Only sent below version 8, where axis_value120 replaces it
+        static void pointer_axis_discrete(void* data, wl_pointer* wl_pointer, std::uint32_t axis, std::int32_t discrete)
+        {
+            if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+                return;
+
+            auto state = static_cast<wayland_state*>(data);
+            state->pending_axis120[axis] += discrete * 120;
+        }
+
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+        static void pointer_axis_value120(void* data, wl_pointer* wl_pointer, std::uint32_t axis, std::int32_t value120)
+        {
+            if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+                return;
+
+            auto state = static_cast<wayland_state*>(data);
+            state->pending_axis120[axis] += value120;
+        }
+#endif
 
-    class window
+        // Up carries no position, so active contacts are tracked to report where they ended
+        static void touch_down(void* data, wl_touch* wl_touch, std::uint32_t serial, std::uint32_t time, wl_surface* surface, std::int32_t id, wl_fixed_t x, wl_fixed_t y)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            touch_point point{ id, touch_phases::down, static_cast<float>(wl_fixed_to_double(x)), static_cast<float>(wl_fixed_to_double(y)) };
+
+            state->touches.push_back(point);
+            state->add_touch(point.id, point.phase, point.x, point.y);
+        }
+
+        static void touch_up(void* data, wl_touch* wl_touch, std::uint32_t serial, std::uint32_t time, std::int32_t id)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            for (auto it = state->touches.begin(); it != state->touches.end(); ++it)
+            {
+                if (it->id != id)
+                    continue;
+
+                state->add_touch(id, touch_phases::up, it->x, it->y);
+                state->touches.erase(it);
+                break;
+            }
+        }
+
+        static void touch_motion(void* data, wl_touch* wl_touch, std::uint32_t time, std::int32_t id, wl_fixed_t x, wl_fixed_t y)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            for (touch_point& point : state->touches)
+            {
+                if (point.id != id)
+                    continue;
+
+                point.x = static_cast<float>(wl_fixed_to_double(x));
+                point.y = static_cast<float>(wl_fixed_to_double(y));
+                state->add_touch(id, touch_phases::motion, point.x, point.y);
+                break;
+            }
+        }
+
+        static void touch_frame(void* data, wl_touch* wl_touch)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            if (!state->touch_points.empty())
+                state->emit_touch();
+        }
+
+        // Cancels every active contact and is not followed by a frame
+        static void touch_cancel(void* data, wl_touch* wl_touch)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            for (const touch_point& point : state->touches)
+                state->add_touch(point.id, touch_phases::cancel, point.x, point.y);
+            state->touches.clear();
+
+            if (!state->touch_points.empty())
+                state->emit_touch();
+        }
+
+        static void keyboard_enter(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, wl_surface* surface, wl_array* keys)
+        {
+            auto state = static_cast<wayland_state*>(data);
+
+            std::uint32_t* key = static_cast<std::uint32_t*>(keys->data);
+            std::uint32_t* end = key + keys->size / sizeof(std::uint32_t);
+            for (; key != end; ++key)
+                state->input.set_key(from_evdev_key(*key), true);
+        }
+
+        static void keyboard_leave(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, wl_surface* surface)
+        {
+            // Releases that happen while unfocused are never delivered to us
+            auto state = static_cast<wayland_state*>(data);
+            state->input.keys.fill(0);
+            state->stop_key_repeat();
+        }
+
+        static void keyboard_key(void* data, wl_keyboard* wl_keyboard, std::uint32_t serial, std::uint32_t time, std::uint32_t key, std::uint32_t key_state)
+        {
+            auto state = static_cast<wayland_state*>(data);
+
+            unsigned int keycode = from_evdev_key(key);
+            bool is_down = key_state == WL_KEYBOARD_KEY_STATE_PRESSED;
+            state->input.set_key(keycode, is_down);
+
+            // Only the last repeating key pressed repeats, like on every other platform. Modifiers and locks leave
+            // the current repeat alone, so holding a key and pressing Shift keeps it going.
+            if (is_down)
+            {
+                bool repeats = is_repeating_key(key);
+                if (repeats)
+                    state->stop_key_repeat();
+                state->emit(key_down_event{ keycode, false });
+                if (repeats)
+                    state->start_key_repeat(keycode);
+            }
+            else
+            {
+                if (state->repeating && state->repeat_key == keycode)
+                    state->stop_key_repeat();
+                state->emit(key_up_event{ keycode });
+            }
+        }
+
+        // A rate of 0 turns repeat off, the new values apply from the next key press
+        static void keyboard_repeat_info(void* data, wl_keyboard* wl_keyboard, std::int32_t rate, std::int32_t delay)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            state->repeat_rate = rate;
+            state->repeat_delay = delay;
+            if (rate <= 0)
+                state->stop_key_repeat();
+        }
+
+#ifdef ACCEL_WINDOW_FRACTIONAL_SCALE
+        // The scale comes as a numerator over 120
+        static void fractional_scale_preferred(void* data, wp_fractional_scale_v1* wp_fractional_scale_v1, std::uint32_t scale)
+        {
+            auto state = static_cast<wayland_state*>(data);
+
+            float new_scale = static_cast<float>(scale) / 120.0f;
+            if (new_scale == state->scale)
+                return;
+
+            state->scale = new_scale;
+            state->emit(scale_event{ new_scale });
+            state->publish();
+        }
+#endif
+
+        static void surface_enter(void* data, wl_surface* wl_surface, wl_output* output)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            if (wayland_output* entered = state->find_output(output))
+                state->set_current_output(entered->global_name, true);
+        }
+
+        static void surface_leave(void* data, wl_surface* wl_surface, wl_output* output)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            if (wayland_output* left = state->find_output(output))
+                state->set_current_output(left->global_name, false);
+        }
+
+        // Each frame request is answered once, the callback object is gone after done
+        static void surface_frame_done(void* data, wl_callback* wl_callback, std::uint32_t time)
+        {
+            auto state = static_cast<wayland_state*>(data);
+            wl_callback_destroy(wl_callback);
+            state->frame_callback = nullptr;
+            state->frame_due = true;
+        }
+
+        // xdg_output reports the logical position instead when it is bound
+        static void output_geometry(void* data, wl_output* wl_output, std::int32_t x, std::int32_t y, std::int32_t physical_width, std::int32_t physical_height, std::int32_t subpixel, const char* make, const char* model, std::int32_t transform)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            output->transform = transform;
+
+            if (!output->xdg_output)
+            {
+                output->pending.x = x;
+                output->pending.y = y;
+            }
+        }
+
+        // Refresh rates already come in millihertz
+        static void output_mode(void* data, wl_output* wl_output, std::uint32_t flags, std::int32_t width, std::int32_t height, std::int32_t refresh)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            if (!(flags & WL_OUTPUT_MODE_CURRENT))
+                return;
+
+            output->mode_width = width;
+            output->mode_height = height;
+            output->pending.refresh_mhz = static_cast<unsigned int>(std::max(0, refresh));
+        }
+
+        static void output_done(void* data, wl_output* wl_output)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            output->state->commit_output(*output);
+        }
+
+        static void output_scale(void* data, wl_output* wl_output, std::int32_t factor)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            output->pending.scale = static_cast<float>(factor);
+        }
+
+        static void output_name(void* data, wl_output* wl_output, const char* name)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            output->pending.name = utf8::string(name);
+        }
+
+        static void xdg_output_logical_position(void* data, zxdg_output_v1* zxdg_output_v1, std::int32_t x, std::int32_t y)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            output->pending.x = x;
+            output->pending.y = y;
+        }
+
+        static void xdg_output_logical_size(void* data, zxdg_output_v1* zxdg_output_v1, std::int32_t width, std::int32_t height)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            output->logical_width = width;
+            output->logical_height = height;
+        }
+
+        // From version 3 on the xdg_output changes are closed by wl_output.done instead
+        static void xdg_output_done(void* data, zxdg_output_v1* zxdg_output_v1)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            if (output->announced)
+                output->state->commit_output(*output);
+        }
+
+        // Only used when wl_output is too old to name the output itself
+        static void xdg_output_name(void* data, zxdg_output_v1* zxdg_output_v1, const char* name)
+        {
+            auto output = static_cast<wayland_output*>(data);
+            if (wl_output_get_version(output->output) < WL_OUTPUT_NAME_SINCE_VERSION)
+                output->pending.name = utf8::string(name);
+        }
+    }
+
+    class wayland_window
     {
     public:
-        window(const window_create_params& params) :
-            m_state(params.client_width, params.client_height)
+        using native_handle_t = details::wayland_state&;
+        using command_t = std::function<void(wayland_window&)>;
+
+        wayland_window(const window_create_params& params) :
+            m_state(params.client_width, params.client_height, details::get_subscription(params), params.style[window_style_bits::hidden]),
+            m_title(params.title)
         {
-            zxdg_toplevel_decoration_v1_set_mode(m_state.decoration, ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
+            ACCEL_WINDOW_TRACE_SCOPE("wayland_window::wayland_window");
+
             xdg_toplevel_set_title(m_state.top_level, params.title.data());
+            set_style(params.style);
+        }
+
+        wayland_window(const wayland_window&) = delete;
+        wayland_window& operator=(const wayland_window&) = delete;
+
+        // Wayland keeps decorations and global positions to the compositor, so outer sizes match the client
+        // size and the position is always reported as the origin
+        unsigned int get_client_width() const { return static_cast<unsigned int>(m_state.width); }
+        unsigned int get_client_height() const { return static_cast<unsigned int>(m_state.height); }
+        unsigned int get_width() const { return get_client_width(); }
+        unsigned int get_height() const { return get_client_height(); }
+        int get_x() const { return 0; }
+        int get_y() const { return 0; }
 
+        bool is_closing() const { return m_state.is_closing; }
+        bool is_resizable() const { return m_style[window_style_bits::resizable]; }
+        bool is_undecorated() const { return m_style[window_style_bits::undecorated]; }
+        bool is_hidden() const { return m_style[window_style_bits::hidden]; }
+        bool is_fullscreen() const { return m_state.fullscreen; }
+        bool is_hiding_mouse() const { return m_style[window_style_bits::hide_mouse]; }
+        bool is_trapping_mouse() const { return m_style[window_style_bits::trap_mouse]; }
+        flagset<window_style_bits> get_style() const { return m_style; }
+        flagset<event_types> get_event_subscription() const { return m_state.subscription; }
+        visibility_states get_visibility() const { return m_state.visibility; }
+        bool is_occluded() const { return details::is_occluded(m_state.visibility); }
+        bool is_active() const { return m_state.active; }
+        bool is_key_down(unsigned int keycode) const { return m_state.input.is_key_down(keycode); }
+        bool is_button_down(mouse_buttons button) const { return m_state.input.is_button_down(button); }
+        input_state get_input_state() const { return m_state.input; }
+        const window_stats& stats() const { return m_state.stats; }
+
+        utf8::string get_title() const { return m_title; }
+
+        void set_title(const utf8::string& title)
+        {
+            xdg_toplevel_set_title(m_state.top_level, title.data());
+            m_state.flush();
+            m_title = title;
+        }
+
+        // Clients cannot position their own toplevels on Wayland
+        void set_position(int x, int y)
+        {
+        }
+
+        void set_size(unsigned int width, unsigned int height)
+        {
+            set_client_size(width, height);
+        }
+
+        void set_client_size(unsigned int width, unsigned int height)
+        {
+            if (m_state.hidden)
+            {
+                m_state.width = static_cast<std::int32_t>(width);
+                m_state.height = static_cast<std::int32_t>(height);
+            }
+            else
+            {
+                m_state.resize_surface(static_cast<std::int32_t>(width), static_cast<std::int32_t>(height));
+            }
+
+            if (!is_resizable())
+                set_resizable(false);
+            else
+                m_state.flush();
+        }
+
+        void set_rect(int x, int y, unsigned int width, unsigned int height)
+        {
+            set_position(x, y);
+            set_size(width, height);
+        }
+
+        void set_resizable(bool state)
+        {
+            std::int32_t width = state ? 0 : m_state.width;
+            std::int32_t height = state ? 0 : m_state.height;
+            xdg_toplevel_set_min_size(m_state.top_level, width, height);
+            xdg_toplevel_set_max_size(m_state.top_level, width, height);
+            wl_surface_commit(m_state.surf);
+            m_state.flush();
+
+            m_style.set(window_style_bits::resizable, state);
+        }
+
+        // Without server side decorations nothing is drawn around the surface
+        void set_undecorated(bool state)
+        {
+            zxdg_toplevel_decoration_v1_set_mode(m_state.decoration, state ? ZXDG_TOPLEVEL_DECORATION_V1_MODE_CLIENT_SIDE : ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
             wl_surface_commit(m_state.surf);
+            m_state.flush();
+
+            m_style.set(window_style_bits::undecorated, state);
+        }
+
+        // The compositor picks the output when output_id is 0 or not one get_outputs knows
+        void set_fullscreen(bool state, std::uint64_t output_id = 0)
+        {
+            if (state)
+            {
+                wl_output* output = nullptr;
+                for (const std::unique_ptr<details::wayland_output>& current : m_state.outputs)
+                {
+                    if (current->global_name == output_id)
+                        output = current->output;
+                }
+
+                xdg_toplevel_set_fullscreen(m_state.top_level, output);
+
+                // Declaring the whole surface opaque lets the compositor scan the buffer out instead of blending it
+                wl_region* region = wl_compositor_create_region(m_state.compositor);
+                wl_region_add(region, 0, 0, INT32_MAX, INT32_MAX);
+                wl_surface_set_opaque_region(m_state.surf, region);
+                wl_region_destroy(region);
+            }
+            else
+            {
+                xdg_toplevel_unset_fullscreen(m_state.top_level);
+                wl_surface_set_opaque_region(m_state.surf, nullptr);
+            }
+
+            wl_surface_commit(m_state.surf);
+            m_state.flush();
+        }
+
+        // Direct scanout is decided by the compositor and never reported back
+        compositor_bypass_states get_bypass_state() const
+        {
+            return m_state.fullscreen ? compositor_bypass_states::requested : compositor_bypass_states::inactive;
+        }
+
+        void set_hidden(bool state)
+        {
+            if (state && !m_state.hidden)
+                m_state.unmap();
+            else if (!state && m_state.hidden)
+                m_state.map();
+
+            m_state.flush();
+
+            m_style.set(window_style_bits::hidden, state);
+        }
+
+        // Without a cursor theme the default cursor cannot be restored here, the compositor picks one again on the next enter
+        void set_hide_mouse(bool state)
+        {
+            m_state.hide_cursor = state;
+            if (state && m_state.pointer && m_state.pointer_serial)
+                wl_pointer_set_cursor(m_state.pointer, m_state.pointer_serial, nullptr, 0, 0);
+
+            m_state.flush();
+
+            m_style.set(window_style_bits::hide_mouse, state);
+        }
+
+        // Confining the pointer needs the pointer-constraints protocol, which is not bound
+        void set_trap_mouse(bool state)
+        {
+            m_style.set(window_style_bits::trap_mouse, state);
+        }
+
+        void set_style(const flagset<window_style_bits>& style)
+        {
+            ACCEL_WINDOW_TRACE_SCOPE("wayland_window::set_style");
+
+            set_resizable(style[window_style_bits::resizable]);
+            set_undecorated(style[window_style_bits::undecorated]);
+            set_hidden(style[window_style_bits::hidden]);
+            set_hide_mouse(style[window_style_bits::hide_mouse]);
+            set_trap_mouse(style[window_style_bits::trap_mouse]);
+        }
+
+        // Applies the title, client size, style and subscription of params in one go, meant for reusing
+        // a hidden window. The requests share a single flush, a window that was already configured while
+        // hidden is shown without waiting on the compositor. Whatever the previous owner left queued is
+        // dispatched and dropped, and its input, key repeat, fullscreen and statistics start over.
+        void retarget(const window_create_params& params)
+        {
+            ACCEL_WINDOW_TRACE_SCOPE("wayland_window::retarget");
+
+            std::vector<generic_event> discarded;
+            poll_events(std::back_inserter(discarded));
+
+            // Stopping flushes repeats that were already due into the event list, which is dropped as well
+            m_state.stop_key_repeat();
+            m_state.events.clear();
+            m_state.input.clear();
+            m_state.motion_history.clear();
+            m_state.stats.reset();
+
+            bool batching = m_state.batching;
+            m_state.batching = true;
+
+            set_fullscreen(false);
+            set_title(params.title);
+            set_event_subscription(details::get_subscription(params));
+            set_client_size(params.client_width, params.client_height);
+            set_style(params.style);
+
+            m_state.batching = batching;
+
+            if (m_state.flush_pending)
+                m_state.flush();
+        }
+
+        // Can be called from any thread, the command runs on the owning thread during its next poll_events
+        std::future<void> post(command_t command)
+        {
+            return m_commands.post(std::move(command));
         }
 
-        bool is_closing() const
+        // Can be called from any thread, reflects the events dispatched by the last poll_events
+        window_state get_state() const
         {
-            return m_state.is_closing;
+            return m_state.published.load();
+        }
+
+        // Draws into a buffer of the client size times scale that the compositor stretches over the client area,
+        // rendering at scale_event's preferred scale gives native resolution and anything below trades sharpness
+        // for fill rate. Needs wp_viewporter, without it the render scale stays at 1.
+        void set_render_scale(float scale)
+        {
+            if (!m_state.viewport || !(scale > 0.0f) || scale == m_state.render_scale)
+                return;
+
+            m_state.render_scale = scale;
+
+            if (m_state.memory)
+                m_state.resize_surface(m_state.width, m_state.height);
+
+            m_state.flush();
+        }
+
+        float get_render_scale() const { return m_state.render_scale; }
+
+        // The scale of an output is fractional when xdg_output reports its logical size
+        std::vector<output_info> get_outputs() const
+        {
+            std::vector<output_info> outputs;
+            for (const std::unique_ptr<details::wayland_output>& output : m_state.outputs)
+            {
+                if (output->announced)
+                    outputs.push_back(output->info);
+            }
+            return outputs;
+        }
+
+        // Outputs the compositor says the surface is shown on
+        std::vector<std::uint64_t> get_current_outputs() const { return m_state.current_outputs; }
+
+        // Every pointer position decoded by the last poll_events, oldest first. Only valid on the owning thread.
+        const std::vector<motion_sample>& get_motion_history() const { return m_state.motion_history; }
+
+        void set_event_subscription(const flagset<event_types>& events)
+        {
+            m_state.subscription = events;
+            m_state.update_input_devices();
+            m_state.flush();
         }
 
         template<typename ItT>
         void poll_events(ItT position_it)
         {
+            ACCEL_WINDOW_TRACE_SCOPE("wayland_window::poll_events");
+
+            auto poll_start = std::chrono::steady_clock::now();
+
+            // Requests made by posted commands go out with the flush below
+            m_state.batching = true;
+            m_commands.apply(*this);
+            m_state.batching = false;
+
+            m_state.motion_history.clear();
+
             while (wl_display_prepare_read(m_state.display) != 0)
                 wl_display_dispatch_pending(m_state.display);
 
-            wl_display_flush(m_state.display);
+            m_state.flush();
             wl_display_read_events(m_state.display);
+            wl_display_dispatch_pending(m_state.display);
+
+            m_state.emit_key_repeats();
+
+            if (!m_state.scroll.empty())
+            {
+                if (m_state.scroll.count() > 1)
+                    window_stats::add(m_state.stats.events_coalesced, m_state.scroll.count() - 1);
+                m_state.emit(m_state.scroll.take());
+            }
+
+            std::copy(m_state.events.cbegin(), m_state.events.cend(), position_it);
+
+            m_state.events.clear();
+
+            m_state.stats.add_poll(std::chrono::steady_clock::now() - poll_start);
         }
 
         native_handle_t get_platform_handle() const { return m_state; }
 
+        // The display connection and the key repeat timer, readable when poll_events has something to decode
+        std::vector<int> get_event_fds() const
+        {
+            std::vector<int> fds{ wl_display_get_fd(m_state.display) };
+            if (m_state.repeat_fd >= 0)
+                fds.push_back(m_state.repeat_fd);
+            return fds;
+        }
+
+        // Asks the compositor when to draw the next frame. The request goes out with an empty commit, the answer
+        // arrives on the display fd and is held back while the surface is not shown. Returns false on backends
+        // where the compositor does not pace frames.
+        bool request_frame()
+        {
+            if (!m_state.frame_callback)
+            {
+                m_state.frame_callback = wl_surface_frame(m_state.surf);
+                wl_callback_add_listener(m_state.frame_callback, &details::frame_listener, &m_state);
+                wl_surface_commit(m_state.surf);
+                m_state.flush();
+            }
+
+            return true;
+        }
+
+        // Whether the frame asked for by request_frame came due during the polls since the last call
+        bool take_frame()
+        {
+            bool due = m_state.frame_due;
+            m_state.frame_due = false;
+            return due;
+        }
+
     private:
         mutable details::wayland_state m_state;
-        wl_buffer* m_buffer;
+        details::command_queue<wayland_window> m_commands;
+        utf8::string m_title;
+        flagset<window_style_bits> m_style;
     };
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include <unordered_map>
 #include <algorithm>
+#include <iterator>
+#include <memory>
+
+#include <cwchar>
 
 #define UNICODE
 #define WINDOW_CLASS L"AccelWindow"
@@ -9,9 +13,7 @@
 
 namespace accel
 {
-    using native_handle_t = HWND;
-
-    class window;
+    class win32_window;
 
     namespace details
     {
@@ -55,17 +57,113 @@ namespace accel
             ClipCursor(&rect);
         }
 
+        // Windows 8.1+, without it every output reports the system DPI scale of 1
+        static float get_monitor_scale(HMONITOR monitor)
+        {
+            using api_call = HRESULT(*)(HMONITOR, int, UINT*, UINT*);
+
+#ifndef _MSC_VER
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-function-type"
+#endif
+            static api_call get_dpi = reinterpret_cast<api_call>(GetProcAddress(LoadLibraryW(L"shcore.dll"), "GetDpiForMonitor"));
+#ifndef _MSC_VER
+#pragma GCC diagnostic pop
+#endif
+
+            UINT dpi_x = 0;
+            UINT dpi_y = 0;
+            if (get_dpi && get_dpi(monitor, 0, &dpi_x, &dpi_y) == S_OK && dpi_x)
+                return static_cast<float>(dpi_x) / 96.0f;
+
+            return 1.0f;
+        }
+
+        // The display configuration keeps fractional rates like 59.94 Hz, EnumDisplaySettings only has whole hertz
+        static unsigned int get_monitor_refresh_mhz(const wchar_t* device)
+        {
+            UINT32 path_count = 0;
+            UINT32 mode_count = 0;
+            if (GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &path_count, &mode_count) == ERROR_SUCCESS)
+            {
+                std::vector<DISPLAYCONFIG_PATH_INFO> paths(path_count);
+                std::vector<DISPLAYCONFIG_MODE_INFO> modes(mode_count);
+                if (QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &path_count, paths.data(), &mode_count, modes.data(), nullptr) == ERROR_SUCCESS)
+                {
+                    for (UINT32 i = 0; i < path_count; i++)
+                    {
+                        DISPLAYCONFIG_SOURCE_DEVICE_NAME source{};
+                        source.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME;
+                        source.header.size = sizeof(source);
+                        source.header.adapterId = paths[i].sourceInfo.adapterId;
+                        source.header.id = paths[i].sourceInfo.id;
+                        if (DisplayConfigGetDeviceInfo(&source.header) != ERROR_SUCCESS || std::wcscmp(source.viewGdiDeviceName, device) != 0)
+                            continue;
+
+                        const DISPLAYCONFIG_RATIONAL& rate = paths[i].targetInfo.refreshRate;
+                        if (rate.Denominator)
+                            return static_cast<unsigned int>((static_cast<std::uint64_t>(rate.Numerator) * 1000 + rate.Denominator / 2) / rate.Denominator);
+                    }
+                }
+            }
+
+            DEVMODEW mode{};
+            mode.dmSize = sizeof(mode);
+            if (EnumDisplaySettingsW(device, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+                return mode.dmDisplayFrequency * 1000;
+
+            return 0;
+        }
+
+        static BOOL CALLBACK add_monitor(HMONITOR monitor, HDC hdc, LPRECT area, LPARAM data)
+        {
+            auto outputs = reinterpret_cast<std::vector<output_info>*>(data);
+
+            MONITORINFOEXW info{};
+            info.cbSize = sizeof(info);
+            if (!GetMonitorInfoW(monitor, &info))
+                return TRUE;
+
+            output_info output{};
+            output.id = reinterpret_cast<std::uintptr_t>(monitor);
+            output.name = utf8::string(std::wstring(info.szDevice));
+            output.x = info.rcMonitor.left;
+            output.y = info.rcMonitor.top;
+            output.width = static_cast<unsigned int>(info.rcMonitor.right - info.rcMonitor.left);
+            output.height = static_cast<unsigned int>(info.rcMonitor.bottom - info.rcMonitor.top);
+            output.scale = get_monitor_scale(monitor);
+            output.refresh_mhz = get_monitor_refresh_mhz(info.szDevice);
+            outputs->push_back(output);
+
+            return TRUE;
+        }
+
         static LRESULT CALLBACK wndproc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
     }
 
-    class window
+    class win32_window
     {
     public:
-        window(const window_create_params& params) : 
+        using native_handle_t = HWND;
+        using command_t = std::function<void(win32_window&)>;
+
+        win32_window(const window_create_params& params) : 
             m_closing(false),
             m_hwnd(nullptr),
-            m_scroll_amount(0)
+            m_subscription(details::get_subscription(params)),
+            m_visibility(visibility_states::hidden),
+            m_active(false),
+            m_stats(new window_stats()),
+            m_commands(new details::command_queue<win32_window>()),
+            m_published(new details::seqlock<window_state>(window_state{ params.client_width, params.client_height, 1.0f, false, visibility_states::hidden })),
+            m_client_width(params.client_width),
+            m_client_height(params.client_height),
+            m_fullscreen(false),
+            m_windowed_style(0),
+            m_windowed_rect()
         {
+            ACCEL_WINDOW_TRACE_SCOPE("win32_window::win32_window");
+
             static HINSTANCE hinstance = GetModuleHandleW(nullptr);
             static bool initialized = false;
             if (!initialized)
@@ -87,21 +185,23 @@ namespace accel
             if (!m_hwnd)
                 throw std::runtime_error("Failed to create window.");
 
+            update_outputs();
+
             set_style(params.style);
             set_client_size(params.client_width, params.client_height);
         }
 
-        ~window()
+        ~win32_window()
         {
             if (m_hwnd)
                 DestroyWindow(m_hwnd);
         }
 
-        window(const window&) = delete;
-        window& operator=(const window&) = delete;
+        win32_window(const win32_window&) = delete;
+        win32_window& operator=(const win32_window&) = delete;
 
-        window(window&&) = default;
-        window& operator=(window&&) = default;
+        win32_window(win32_window&&) = default;
+        win32_window& operator=(win32_window&&) = default;
 
         unsigned int get_client_width() const
         {
@@ -144,10 +244,19 @@ namespace accel
         bool is_closing() const { return m_closing; }
         bool is_resizable() const { return m_style[window_style_bits::resizable]; }
         bool is_undecorated() const { return m_style[window_style_bits::undecorated]; }
-        bool is_hidden() const { return m_style[window_style_bits::undecorated]; }
+        bool is_hidden() const { return m_style[window_style_bits::hidden]; }
+        bool is_fullscreen() const { return m_fullscreen; }
         bool is_hiding_mouse() const { return m_style[window_style_bits::hide_mouse]; }
         bool is_trapping_mouse() const { return m_style[window_style_bits::trap_mouse]; }
         flagset<window_style_bits> get_style() const { return m_style; }
+        flagset<event_types> get_event_subscription() const { return m_subscription; }
+        visibility_states get_visibility() const { return m_visibility; }
+        bool is_occluded() const { return details::is_occluded(m_visibility); }
+        bool is_active() const { return m_active; }
+        bool is_key_down(unsigned int keycode) const { return m_input.is_key_down(keycode); }
+        bool is_button_down(mouse_buttons button) const { return m_input.is_button_down(button); }
+        input_state get_input_state() const { return m_input; }
+        const window_stats& stats() const { return *m_stats; }
         
         utf8::string get_title() const
         {
@@ -239,6 +348,44 @@ namespace accel
             m_style.set(window_style_bits::undecorated, state);
         }
 
+        // Borderless fullscreen covering the monitor, the window stays on its current monitor when output_id is 0 or unknown.
+        // DWM flips such windows without composing them when the swap chain allows it.
+        void set_fullscreen(bool state, std::uint64_t output_id = 0)
+        {
+            if (state)
+            {
+                if (!m_fullscreen)
+                {
+                    m_windowed_style = GetWindowLongPtrW(m_hwnd, GWL_STYLE);
+                    GetWindowRect(m_hwnd, &m_windowed_rect);
+                }
+
+                HMONITOR monitor = details::find_output(m_outputs, output_id) ? reinterpret_cast<HMONITOR>(static_cast<std::uintptr_t>(output_id)) : MonitorFromWindow(m_hwnd, MONITOR_DEFAULTTONEAREST);
+
+                MONITORINFO info{};
+                info.cbSize = sizeof(info);
+                GetMonitorInfoW(monitor, &info);
+
+                const RECT& area = info.rcMonitor;
+                SetWindowLongPtrW(m_hwnd, GWL_STYLE, (m_windowed_style & ~WS_OVERLAPPEDWINDOW) | WS_POPUP);
+                SetWindowPos(m_hwnd, HWND_TOP, area.left, area.top, area.right - area.left, area.bottom - area.top, SWP_FRAMECHANGED | SWP_NOACTIVATE);
+            }
+            else if (m_fullscreen)
+            {
+                const RECT& area = m_windowed_rect;
+                SetWindowLongPtrW(m_hwnd, GWL_STYLE, m_windowed_style);
+                SetWindowPos(m_hwnd, nullptr, area.left, area.top, area.right - area.left, area.bottom - area.top, SWP_FRAMECHANGED | SWP_NOZORDER | SWP_NOACTIVATE);
+            }
+
+            m_fullscreen = state;
+        }
+
+        // Whether DWM flips the window directly depends on the swap chain and is not observable from here
+        compositor_bypass_states get_bypass_state() const
+        {
+            return m_fullscreen ? compositor_bypass_states::requested : compositor_bypass_states::inactive;
+        }
+
         void set_hidden(bool state)
         {
             if (state)
@@ -271,6 +418,8 @@ namespace accel
 
         void set_style(const flagset<window_style_bits>& style)
         {
+            ACCEL_WINDOW_TRACE_SCOPE("win32_window::set_style");
+
             set_resizable(style[window_style_bits::resizable]);
             set_undecorated(style[window_style_bits::undecorated]);
             set_hidden(style[window_style_bits::hidden]);
@@ -278,9 +427,81 @@ namespace accel
             set_trap_mouse(style[window_style_bits::trap_mouse]);
         }
 
+        // Applies the title, client size, style and subscription of params in one go, meant for reusing
+        // a hidden window. Frame styles change first so the client size accounts for them, showing comes last.
+        // Whatever the previous owner left queued is processed and dropped, and its input, fullscreen and
+        // statistics start over.
+        void retarget(const window_create_params& params)
+        {
+            ACCEL_WINDOW_TRACE_SCOPE("win32_window::retarget");
+
+            std::vector<generic_event> discarded;
+            poll_events(std::back_inserter(discarded));
+
+            m_input.clear();
+            m_motion_history.clear();
+            m_stats->reset();
+
+            set_fullscreen(false);
+            set_title(params.title);
+            set_event_subscription(details::get_subscription(params));
+            set_resizable(params.style[window_style_bits::resizable]);
+            set_undecorated(params.style[window_style_bits::undecorated]);
+            set_client_size(params.client_width, params.client_height);
+            set_hidden(params.style[window_style_bits::hidden]);
+
+            // ShowCursor keeps a counter, only touch it on a change
+            if (params.style[window_style_bits::hide_mouse] != is_hiding_mouse())
+                set_hide_mouse(params.style[window_style_bits::hide_mouse]);
+
+            set_trap_mouse(params.style[window_style_bits::trap_mouse]);
+        }
+
+        // Can be called from any thread, the command runs on the owning thread during its next poll_events
+        std::future<void> post(command_t command)
+        {
+            return m_commands->post(std::move(command));
+        }
+
+        // Can be called from any thread, reflects the messages processed by the last poll_events
+        window_state get_state() const
+        {
+            return m_published->load();
+        }
+
+        // Monitor handles serve as ids, they stay valid until the display configuration changes
+        std::vector<output_info> get_outputs() const { return m_outputs; }
+
+        // Monitors the visible window overlaps, empty while hidden or minimized
+        std::vector<std::uint64_t> get_current_outputs() const { return m_current_outputs; }
+
+        // Every pointer position decoded by the last poll_events, oldest first. Only valid on the owning thread.
+        const std::vector<motion_sample>& get_motion_history() const { return m_motion_history; }
+
+        // Nothing stretches the client area here, the render scale always stays at 1
+        void set_render_scale(float)
+        {
+        }
+
+        float get_render_scale() const { return 1.0f; }
+
+        // Window messages cannot be filtered at the source, unsubscribed events are dropped in _wndproc
+        void set_event_subscription(const flagset<event_types>& events)
+        {
+            m_subscription = events;
+        }
+
         template<typename ItT>
         void poll_events(ItT position_it)
         {
+            ACCEL_WINDOW_TRACE_SCOPE("win32_window::poll_events");
+
+            auto poll_start = std::chrono::steady_clock::now();
+
+            m_commands->apply(*this);
+
+            m_motion_history.clear();
+
             MSG msg;
             while (PeekMessageW(&msg, m_hwnd, 0, 0, PM_REMOVE))
             {
@@ -288,9 +509,18 @@ namespace accel
                 DispatchMessageW(&msg);
             }
 
+            if (!m_scroll.empty())
+            {
+                if (m_scroll.count() > 1)
+                    window_stats::add(m_stats->events_coalesced, m_scroll.count() - 1);
+                emit(m_scroll.take());
+            }
+
             std::copy(m_events.cbegin(), m_events.cend(), position_it);
             
             m_events.clear();
+
+            m_stats->add_poll(std::chrono::steady_clock::now() - poll_start);
         }
 
         native_handle_t get_platform_handle() const { return m_hwnd; }
@@ -324,10 +554,14 @@ namespace accel
                         break;
                     }
 
-                    if (msg == WM_KEYDOWN || msg == WM_SYSKEYDOWN)
-                        m_events.emplace_back(key_down_event{ static_cast<unsigned int>(keycode) });
+                    bool is_down = msg == WM_KEYDOWN || msg == WM_SYSKEYDOWN;
+                    m_input.set_key(static_cast<unsigned int>(keycode), is_down);
+
+                    // Bit 30 holds the previous key state, it is set for auto-repeated presses
+                    if (is_down)
+                        emit(key_down_event{ static_cast<unsigned int>(keycode), ((lparam >> 30) & 1) != 0 });
                     else
-                        m_events.emplace_back(key_up_event{ static_cast<unsigned int>(keycode) });
+                        emit(key_up_event{ static_cast<unsigned int>(keycode) });
                     break;
                 }
 
@@ -353,10 +587,13 @@ namespace accel
                     else
                         button = GET_XBUTTON_WPARAM(wparam) == XBUTTON1 ? mouse_buttons::backwards : mouse_buttons::forwards;
 
-                    if (msg == WM_LBUTTONDOWN || msg == WM_MBUTTONDOWN || msg == WM_RBUTTONDOWN || msg == WM_XBUTTONDOWN)
-                        m_events.emplace_back(mouse_down_event{ button, x_pos, y_pos });
+                    bool is_down = msg == WM_LBUTTONDOWN || msg == WM_MBUTTONDOWN || msg == WM_RBUTTONDOWN || msg == WM_XBUTTONDOWN;
+                    m_input.set_button(button, is_down);
+
+                    if (is_down)
+                        emit(mouse_down_event{ button, x_pos, y_pos });
                     else
-                        m_events.emplace_back(mouse_up_event{ button, x_pos, y_pos });
+                        emit(mouse_up_event{ button, x_pos, y_pos });
                     
                     break;
                 }
@@ -370,8 +607,20 @@ namespace accel
                     break;
 
                 case WM_ACTIVATE:
-                    if (wparam == WA_INACTIVE)
+                {
+                    bool active = LOWORD(wparam) != WA_INACTIVE;
+                    if (active != m_active)
                     {
+                        m_active = active;
+                        publish_state();
+                        emit(activate_event{ active });
+                    }
+
+                    if (!active)
+                    {
+                        // Releases that happen while inactive are never delivered to us
+                        m_input.clear();
+
                         if (m_style & window_style_bits::trap_mouse)
                             ClipCursor(nullptr);
                     }
@@ -381,37 +630,97 @@ namespace accel
                             details::trap_mouse(m_hwnd);
                     }
                     break;
+                }
+
+                case WM_PAINT:
+                {
+                    if (!m_subscription[event_types::expose])
+                        break;
+
+                    // DefWindowProcW validates the update region after we read it
+                    HRGN region = CreateRectRgn(0, 0, 0, 0);
+                    if (GetUpdateRgn(hwnd, region, FALSE) != NULLREGION)
+                    {
+                        DWORD size = GetRegionData(region, 0, nullptr);
+                        std::vector<char> buffer(size);
+                        RGNDATA* data = reinterpret_cast<RGNDATA*>(buffer.data());
+                        if (size && GetRegionData(region, size, data))
+                        {
+                            const RECT* rects = reinterpret_cast<const RECT*>(data->Buffer);
+                            if (data->rdh.nCount > 1)
+                                window_stats::add(m_stats->events_coalesced, data->rdh.nCount - 1);
+
+                            for (DWORD i = 0; i < data->rdh.nCount; i++)
+                            {
+                                const RECT& area = rects[i];
+                                m_damage.add(rect{ area.left, area.top, static_cast<unsigned int>(area.right - area.left), static_cast<unsigned int>(area.bottom - area.top) });
+                            }
+                        }
+
+                        if (!m_damage.empty())
+                            emit(m_damage.take());
+                    }
+                    DeleteObject(region);
+                    break;
+                }
+
+                case WM_SHOWWINDOW:
+                    set_visibility(wparam ? visibility_states::visible : visibility_states::hidden);
+                    update_current_outputs();
+                    break;
+
+                case WM_MOVE:
+                    update_current_outputs();
+                    break;
+
+                case WM_DISPLAYCHANGE:
+                    update_outputs();
+                    break;
 
                 case WM_MOUSEMOVE:
                 {
                     int mouse_x = GET_X_LPARAM(lparam);
                     int mouse_y = GET_Y_LPARAM(lparam);
-                    m_events.emplace_back(mouse_move_event{ mouse_x, mouse_y });
+                    m_motion_history.push_back(motion_sample{ static_cast<std::uint32_t>(GetMessageTime()), static_cast<float>(mouse_x), static_cast<float>(mouse_y) });
+                    emit(mouse_move_event{ mouse_x, mouse_y });
                     break;
                 }
 
+                // High resolution wheels send fractions of WHEEL_DELTA. The position is in screen coordinates.
                 case WM_MOUSEWHEEL:
+                case WM_MOUSEHWHEEL:
                 {
-                    UINT lines_per_tick = 0;
-                    SystemParametersInfoW(SPI_GETWHEELSCROLLLINES, 0, &lines_per_tick, 0);
-
-                    m_scroll_amount += GET_WHEEL_DELTA_WPARAM(wparam);
+                    POINT mouse{ GET_X_LPARAM(lparam), GET_Y_LPARAM(lparam) };
+                    ScreenToClient(m_hwnd, &mouse);
 
-                    int mouse_x = GET_X_LPARAM(lparam);
-                    int mouse_y = GET_Y_LPARAM(lparam);
-
-                    bool is_negative = m_scroll_amount < 0;
-                    while (std::abs(m_scroll_amount) >= WHEEL_DELTA)
-                    {
-                        m_events.emplace_back(mouse_scroll_event{ mouse_x, mouse_y, is_negative ? mouse_scroll_directions::down : mouse_scroll_directions::up });
-                        m_scroll_amount += is_negative ? WHEEL_DELTA : -WHEEL_DELTA;
-                    }
+                    float delta = static_cast<float>(GET_WHEEL_DELTA_WPARAM(wparam)) / WHEEL_DELTA;
+                    if (msg == WM_MOUSEWHEEL)
+                        m_scroll.add(mouse.x, mouse.y, 0.0f, delta);
+                    else
+                        m_scroll.add(mouse.x, mouse.y, delta, 0.0f);
 
                     break;
                 }
 
                 case WM_SIZE:
                 {
+                    if (wparam == SIZE_MINIMIZED)
+                    {
+                        set_visibility(visibility_states::hidden);
+                    }
+                    else
+                    {
+                        m_client_width = LOWORD(lparam);
+                        m_client_height = HIWORD(lparam);
+
+                        if (m_visibility == visibility_states::hidden)
+                            set_visibility(visibility_states::visible);
+                        else
+                            publish_state();
+                    }
+
+                    update_current_outputs();
+
                     if (!m_resizing)
                         m_resizing = true;
                     break;
@@ -432,7 +741,7 @@ namespace accel
                         unsigned int client_width = static_cast<unsigned>(client_rect.right - client_rect.left);
                         unsigned int client_height = static_cast<unsigned>(client_rect.bottom - client_rect.top);
 
-                        m_events.emplace_back(resize_event{ width, height, client_width, client_height });
+                        emit(resize_event{ width, height, client_width, client_height });
                         m_resizing = false;
                     }
                     break;
@@ -447,26 +756,95 @@ namespace accel
         HWND m_hwnd;
         bool m_closing;
         bool m_resizing;
-        int m_scroll_amount;
+        details::scroll_accumulator m_scroll;
         flagset<window_style_bits> m_style;
+        flagset<event_types> m_subscription;
+        input_state m_input;
+        visibility_states m_visibility;
+        bool m_active;
+        details::damage_region m_damage;
         std::vector<generic_event> m_events;
+        std::unique_ptr<window_stats> m_stats;
+        std::unique_ptr<details::command_queue<win32_window>> m_commands;
+        std::unique_ptr<details::seqlock<window_state>> m_published;
+        unsigned int m_client_width;
+        unsigned int m_client_height;
+        std::vector<output_info> m_outputs;
+        std::vector<std::uint64_t> m_current_outputs;
+        std::vector<motion_sample> m_motion_history;
+        bool m_fullscreen;
+        LONG_PTR m_windowed_style;
+        RECT m_windowed_rect;
+
+        void update_outputs()
+        {
+            ACCEL_WINDOW_TRACE_SCOPE("win32_window::update_outputs");
+
+            std::vector<output_info> outputs;
+            EnumDisplayMonitors(nullptr, nullptr, &details::add_monitor, reinterpret_cast<LPARAM>(&outputs));
+
+            details::diff_outputs(m_outputs, outputs, [this](output_event&& event) { emit(std::move(event)); });
+            m_outputs.swap(outputs);
+
+            update_current_outputs();
+        }
+
+        void update_current_outputs()
+        {
+            std::vector<std::uint64_t> current;
+
+            if (m_visibility != visibility_states::hidden)
+            {
+                // Runs inside the window procedure, so no DWM query that could throw
+                RECT area{};
+                GetWindowRect(m_hwnd, &area);
+                current = details::get_overlapping_outputs(m_outputs, rect{ area.left, area.top, static_cast<unsigned int>(area.right - area.left), static_cast<unsigned int>(area.bottom - area.top) });
+            }
+
+            details::diff_current_outputs(m_current_outputs, current, [this](output_event&& event) { emit(std::move(event)); });
+            m_current_outputs.swap(current);
+        }
+
+        void emit(generic_event&& event)
+        {
+            bool subscribed = m_subscription[event.type];
+            m_stats->add_event(event.type, !subscribed);
+
+            if (subscribed)
+                m_events.emplace_back(std::move(event));
+        }
+
+        void publish_state()
+        {
+            m_published->store(window_state{ m_client_width, m_client_height, 1.0f, m_active, m_visibility });
+        }
+
+        void set_visibility(visibility_states visibility)
+        {
+            if (visibility == m_visibility)
+                return;
+
+            m_visibility = visibility;
+            publish_state();
+            emit(visibility_event{ visibility });
+        }
     };
 
     namespace details
     {
         static LRESULT CALLBACK wndproc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
         {
-            accel::window* ptr = nullptr;
+            accel::win32_window* ptr = nullptr;
 
             if (msg == WM_CREATE)
             {
                 CREATESTRUCTW* cs = reinterpret_cast<CREATESTRUCTW*>(lparam);
-                ptr = reinterpret_cast<accel::window*>(cs->lpCreateParams);
+                ptr = reinterpret_cast<accel::win32_window*>(cs->lpCreateParams);
                 SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(ptr));
             }
             else
             {
-                ptr = reinterpret_cast<accel::window*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+                ptr = reinterpret_cast<accel::win32_window*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
             }
 
             if (ptr)
@@ -1,21 +1,514 @@
 #include <array>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 namespace accel
 {
-    using native_handle_t = std::pair<Display*, Window>;
+    namespace details
+    {
+        static bool from_x11_button(unsigned int x11_button, mouse_buttons& button)
+        {
+            switch (x11_button)
+            {
+                case Button1: button = mouse_buttons::left; return true;
+                case Button2: button = mouse_buttons::middle; return true;
+                case Button3: button = mouse_buttons::right; return true;
+                case 8: button = mouse_buttons::backwards; return true;
+                case 9: button = mouse_buttons::forwards; return true;
+                default: return false;
+            }
+        }
+
+        static long get_x11_event_mask(const flagset<event_types>& events)
+        {
+            long mask = NoEventMask;
+
+            // Releases are selected along with presses so held keys and buttons are cleared from the input state,
+            // unsubscribed ones are dropped when emitted
+            if (events[event_types::key_down] || events[event_types::key_up])
+                mask |= KeyPressMask | KeyReleaseMask;
+            if (events[event_types::mouse_down] || events[event_types::mouse_up] || events[event_types::mouse_scroll])
+                mask |= ButtonPressMask | ButtonReleaseMask;
+            if (events[event_types::mouse_move])
+                mask |= PointerMotionMask;
+            if (events[event_types::expose])
+                mask |= ExposureMask;
+
+            // Always tracked so is_occluded() and is_fullscreen() stay valid and held keys and buttons are dropped
+            // when the window loses focus, these are rare and cheap. Unsubscribed activate events are dropped when emitted.
+            mask |= FocusChangeMask | VisibilityChangeMask | StructureNotifyMask | PropertyChangeMask;
+
+            return mask;
+        }
+
+        // Scroll valuators count up forever, a delta is the change since the last event over the increment of one notch
+        struct x11_scroll_valuator
+        {
+            int device;
+            int number;
+            bool vertical;
+            double increment;
+            double last;
+            bool has_last;
+        };
+
+        static rect intersect_rect(const rect& area, const rect& bounds)
+        {
+            int left = (std::max)(area.x, bounds.x);
+            int top = (std::max)(area.y, bounds.y);
+            int right = (std::min)(area.x + static_cast<int>(area.width), bounds.x + static_cast<int>(bounds.width));
+            int bottom = (std::min)(area.y + static_cast<int>(area.height), bounds.y + static_cast<int>(bounds.height));
+            if (right <= left || bottom <= top)
+                return rect{ 0, 0, 0, 0 };
+            return rect{ left, top, static_cast<unsigned int>(right - left), static_cast<unsigned int>(bottom - top) };
+        }
+
+        static rect clip_rect(const rect& area, unsigned int width, unsigned int height)
+        {
+            return intersect_rect(area, rect{ 0, 0, width, height });
+        }
+
+        // Xlib reports errors through one process wide handler whose default exits. The first trap installs a handler
+        // that stays for the life of the process and hands every error it does not own on to the handler it replaced.
+        // Windows may live on several threads, so traps are serialized by a lock held for their whole life and only
+        // errors of the trapped display's requests made while the trap is alive are recorded.
+        class x11_error_trap
+        {
+        public:
+            x11_error_trap(Display* display) :
+                m_lock(get_shared().mutex),
+                m_display(display),
+                m_first_serial(NextRequest(display)),
+                m_error_code(Success)
+            {
+                shared_state& shared = get_shared();
+                if (!shared.installed)
+                {
+                    shared.previous_handler = XSetErrorHandler(&handle_error);
+                    shared.installed = true;
+                }
+
+                shared.active.store(this, std::memory_order_relaxed);
+                shared.active_display.store(display, std::memory_order_release);
+            }
+
+            ~x11_error_trap()
+            {
+                get_shared().active_display.store(nullptr, std::memory_order_release);
+                get_shared().active.store(nullptr, std::memory_order_relaxed);
+            }
+
+            x11_error_trap(const x11_error_trap&) = delete;
+            x11_error_trap& operator=(const x11_error_trap&) = delete;
+
+            // Errors of requests without a reply only arrive once the server has processed them
+            int sync()
+            {
+                XSync(m_display, False);
+                return m_error_code;
+            }
+
+            int get_error_code() const { return m_error_code; }
+
+        private:
+            struct shared_state
+            {
+                std::mutex mutex;
+                std::atomic<x11_error_trap*> active;
+                std::atomic<Display*> active_display;
+                XErrorHandler previous_handler;
+                bool installed;
+
+                shared_state() : active(nullptr), active_display(nullptr), previous_handler(nullptr), installed(false) {}
+            };
+
+            std::lock_guard<std::mutex> m_lock;
+            Display* m_display;
+            unsigned long m_first_serial;
+            int m_error_code;
+
+            static shared_state& get_shared()
+            {
+                static shared_state shared;
+                return shared;
+            }
+
+            // Runs on whichever thread got the error, which may hold no trap at all. The display is compared before the
+            // trap is touched, only the thread owning the trapped display can get its errors.
+            static int handle_error(Display* display, XErrorEvent* error)
+            {
+                shared_state& shared = get_shared();
+                x11_error_trap* trap = nullptr;
+                if (display == shared.active_display.load(std::memory_order_acquire))
+                    trap = shared.active.load(std::memory_order_relaxed);
+
+                if (!trap || error->serial < trap->m_first_serial)
+                    return shared.previous_handler ? shared.previous_handler(display, error) : 0;
+
+                if (trap->m_error_code == Success)
+                    trap->m_error_code = error->error_code;
+                return 0;
+            }
+        };
+
+        // Reads window contents through a shared memory segment the server writes into, so pixels never go
+        // through the socket. Areas are read as full width bands straight into place in the reused image.
+        // The server only reads back what is on screen, so areas are clipped to the part of the window inside
+        // the screen and bands the window does not span in full go through XGetSubImage instead.
+        class x11_capture
+        {
+        public:
+            x11_capture(Display* display, Window window, window_stats& stats) :
+                m_display(display),
+                m_window(window),
+                m_stats(stats),
+                m_image(nullptr),
+                m_shm(),
+                m_damage(0),
+                m_damaged(0),
+                m_damage_event_base(0),
+                m_needs_full(true)
+            {
+                int major = 0;
+                int minor = 0;
+                Bool shared_pixmaps = False;
+                if (!XShmQueryVersion(m_display, &major, &minor, &shared_pixmaps))
+                    throw std::runtime_error("Window capture needs the MIT-SHM extension.");
+                window_stats::add(m_stats.round_trips);
+            }
+
+            ~x11_capture()
+            {
+                set_continuous(false);
+                release_image();
+            }
+
+            x11_capture(const x11_capture&) = delete;
+            x11_capture& operator=(const x11_capture&) = delete;
+
+            bool is_continuous() const { return m_damage != 0; }
+
+            void set_continuous(bool state)
+            {
+                if (state == is_continuous())
+                    return;
+
+                if (state)
+                {
+                    int damage_error_base = 0;
+                    int fixes_event_base = 0;
+                    int fixes_error_base = 0;
+                    int major = 1;
+                    int minor = 1;
+                    if (!XDamageQueryExtension(m_display, &m_damage_event_base, &damage_error_base) || 
+                        !XFixesQueryExtension(m_display, &fixes_event_base, &fixes_error_base))
+                        throw std::runtime_error("Continuous capture needs the DAMAGE and XFIXES extensions.");
+
+                    XDamageQueryVersion(m_display, &major, &minor);
+                    major = 2;
+                    minor = 0;
+                    XFixesQueryVersion(m_display, &major, &minor);
+                    window_stats::add(m_stats.round_trips, 2);
+
+                    // Damage only collects from here on, whatever the image holds so far is stale
+                    m_damage = XDamageCreate(m_display, m_window, XDamageReportNonEmpty);
+                    m_damaged = XFixesCreateRegion(m_display, nullptr, 0);
+                    m_needs_full = true;
+                }
+                else
+                {
+                    XDamageDestroy(m_display, m_damage);
+                    XFixesDestroyRegion(m_display, m_damaged);
+                    drain_damage_events();
+                    m_damage = 0;
+                    m_damaged = 0;
+                }
+            }
+
+            // Reads back area, or everything that changed since the last capture when area is null
+            capture_image capture(const XWindowAttributes& attributes, const rect* area)
+            {
+                capture_image image = {};
+                unsigned int width = static_cast<unsigned int>(attributes.width);
+                unsigned int height = static_cast<unsigned int>(attributes.height);
+                if (width == 0 || height == 0)
+                    return image;
+
+                if (update_image(attributes))
+                    m_needs_full = true;
+
+                rect visible = get_visible_area(attributes);
+
+                damage_region changed;
+                if (area)
+                {
+                    changed.add(intersect_rect(*area, visible));
+                }
+                else
+                {
+                    if (is_continuous())
+                        take_damage(changed, visible);
+
+                    if (!is_continuous() || m_needs_full)
+                    {
+                        changed.take();
+                        changed.add(visible);
+                        m_needs_full = false;
+                    }
+                }
+
+                expose_event region = changed.take();
+                read_rows(region, visible);
+
+                image.pixels = reinterpret_cast<const std::uint8_t*>(m_image->data);
+                image.width = width;
+                image.height = height;
+                image.stride = static_cast<unsigned int>(m_image->bytes_per_line);
+                image.changed_count = region.count;
+                std::copy(region.rects, region.rects + region.count, image.changed);
+                return image;
+            }
+
+        private:
+            Display* m_display;
+            Window m_window;
+            window_stats& m_stats;
+            XImage* m_image;
+            XShmSegmentInfo m_shm;
+            Damage m_damage;
+            XserverRegion m_damaged;
+            int m_damage_event_base;
+            bool m_needs_full;
+
+            // Recreates the image when the window size changed, returns whether it did
+            bool update_image(const XWindowAttributes& attributes)
+            {
+                if (m_image && m_image->width == attributes.width && m_image->height == attributes.height)
+                    return false;
+
+                release_image();
+
+                m_image = XShmCreateImage(m_display, attributes.visual, static_cast<unsigned int>(attributes.depth), ZPixmap, nullptr, &m_shm, 
+                    static_cast<unsigned int>(attributes.width), static_cast<unsigned int>(attributes.height));
+                if (!m_image)
+                    throw std::runtime_error("Failed to create capture image.");
+
+                if (m_image->bits_per_pixel != 32)
+                {
+                    XDestroyImage(m_image);
+                    m_image = nullptr;
+                    throw std::runtime_error("Window capture needs a 32 bit visual.");
+                }
+
+                m_shm.shmid = shmget(IPC_PRIVATE, static_cast<std::size_t>(m_image->bytes_per_line) * m_image->height, IPC_CREAT | 0600);
+                if (m_shm.shmid < 0)
+                {
+                    XDestroyImage(m_image);
+                    m_image = nullptr;
+                    throw std::runtime_error("Failed to create capture shared memory.");
+                }
+
+                m_shm.shmaddr = static_cast<char*>(shmat(m_shm.shmid, nullptr, 0));
+                if (m_shm.shmaddr == reinterpret_cast<char*>(-1))
+                {
+                    shmctl(m_shm.shmid, IPC_RMID, nullptr);
+                    XDestroyImage(m_image);
+                    m_image = nullptr;
+                    throw std::runtime_error("Failed to map capture shared memory.");
+                }
+
+                m_image->data = m_shm.shmaddr;
+                m_shm.readOnly = False;
+
+                // Once the server has attached, the segment can be marked for removal so it goes away with both sides.
+                // A server that cannot reach the segment, remote or in another IPC namespace, fails with BadAccess.
+                int error = Success;
+                {
+                    x11_error_trap trap(m_display);
+                    XShmAttach(m_display, &m_shm);
+                    error = trap.sync();
+                }
+                window_stats::add(m_stats.round_trips);
+                shmctl(m_shm.shmid, IPC_RMID, nullptr);
+
+                if (error != Success)
+                {
+                    shmdt(m_shm.shmaddr);
+                    XDestroyImage(m_image);
+                    m_image = nullptr;
+                    throw std::runtime_error("The X server failed to attach the capture shared memory.");
+                }
+                return true;
+            }
+
+            // The part of the window inside the screen, in window coordinates
+            rect get_visible_area(const XWindowAttributes& attributes)
+            {
+                int root_x = 0;
+                int root_y = 0;
+                Window child = None;
+                XTranslateCoordinates(m_display, m_window, attributes.root, 0, 0, &root_x, &root_y, &child);
+                window_stats::add(m_stats.round_trips);
+
+                rect screen{ -root_x, -root_y, static_cast<unsigned int>(WidthOfScreen(attributes.screen)), static_cast<unsigned int>(HeightOfScreen(attributes.screen)) };
+                return clip_rect(screen, static_cast<unsigned int>(attributes.width), static_cast<unsigned int>(attributes.height));
+            }
+
+            // Shared memory images free only their header, the segment is detached separately
+            void release_image()
+            {
+                if (!m_image)
+                    return;
+
+                XShmDetach(m_display, &m_shm);
+                XDestroyImage(m_image);
+                shmdt(m_shm.shmaddr);
+                m_image = nullptr;
+            }
+
+            void drain_damage_events()
+            {
+                XEvent event;
+                while (XCheckTypedEvent(m_display, m_damage_event_base + XDamageNotify, &event));
+            }
+
+            // Moves the damage collected so far out of the server, merged into a few rectangles
+            void take_damage(damage_region& changed, const rect& visible)
+            {
+                drain_damage_events();
+                XDamageSubtract(m_display, m_damage, None, m_damaged);
+
+                int count = 0;
+                XRectangle* rects = XFixesFetchRegion(m_display, m_damaged, &count);
+                window_stats::add(m_stats.round_trips);
+                if (!rects)
+                    return;
+
+                for (int i = 0; i < count; i++)
+                    changed.add(intersect_rect(rect{ rects[i].x, rects[i].y, rects[i].width, rects[i].height }, visible));
+                XFree(rects);
+            }
+
+            // Full width bands keep the server's row padding identical to the image's, so rows land in place.
+            // Rows the window only partly shows on screen are copied by Xlib at the image's stride instead.
+            void read_rows(const expose_event& region, const rect& visible)
+            {
+                bool full_width = visible.x == 0 && static_cast<int>(visible.width) == m_image->width;
+
+                std::array<std::pair<int, int>, expose_event::max_rects> bands;
+                for (unsigned int i = 0; i < region.count; i++)
+                    bands[i] = std::make_pair(region.rects[i].y, region.rects[i].y + static_cast<int>(region.rects[i].height));
+                std::sort(bands.begin(), bands.begin() + region.count);
+
+                unsigned int i = 0;
+                while (i < region.count)
+                {
+                    int top = bands[i].first;
+                    int bottom = bands[i].second;
+                    for (i++; i < region.count && bands[i].first <= bottom; i++)
+                        bottom = (std::max)(bottom, bands[i].second);
+
+                    if (full_width)
+                    {
+                        XImage band = *m_image;
+                        band.height = bottom - top;
+                        band.data = m_image->data + static_cast<std::size_t>(top) * m_image->bytes_per_line;
+
+                        // Fails with BadMatch when the window moved off screen since its position was queried
+                        x11_error_trap trap(m_display);
+                        Status read = XShmGetImage(m_display, m_window, &band, 0, top, AllPlanes);
+                        window_stats::add(m_stats.round_trips);
+                        if (read && trap.get_error_code() == Success)
+                            continue;
+                    }
 
-    class window
+                    read_sub_image(rect{ visible.x, top, visible.width, static_cast<unsigned int>(bottom - top) });
+                }
+            }
+
+            void read_sub_image(const rect& area)
+            {
+                x11_error_trap trap(m_display);
+                XImage* read = XGetSubImage(m_display, m_window, area.x, area.y, area.width, area.height, AllPlanes, ZPixmap, m_image, area.x, area.y);
+                window_stats::add(m_stats.round_trips);
+                if (!read || trap.get_error_code() != Success)
+                    throw std::runtime_error("Failed to read back the window, it is not fully on screen.");
+            }
+        };
+
+        // Pixel clock over the total pixels per frame, interlaced modes scan twice per frame and double scanned ones half
+        static unsigned int get_x11_refresh_mhz(const XRRScreenResources* resources, RRMode mode)
+        {
+            for (int i = 0; i < resources->nmode; i++)
+            {
+                const XRRModeInfo& info = resources->modes[i];
+                if (info.id != mode)
+                    continue;
+
+                double vertical_total = info.vTotal;
+                if (info.modeFlags & RR_DoubleScan)
+                    vertical_total *= 2.0;
+                if (info.modeFlags & RR_Interlace)
+                    vertical_total /= 2.0;
+
+                if (info.hTotal == 0 || vertical_total == 0.0)
+                    return 0;
+
+                return static_cast<unsigned int>(std::llround(info.dotClock * 1000.0 / (info.hTotal * vertical_total)));
+            }
+
+            return 0;
+        }
+    }
+
+    class x11_window
     {
     public:
-        window(const window_create_params& params) : 
+        using native_handle_t = std::pair<Display*, Window>;
+        using command_t = std::function<void(x11_window&)>;
+
+        x11_window(const window_create_params& params) : 
             m_closing(false),
-            m_display(nullptr)
+            m_display(nullptr),
+            m_repeat_keycode(0),
+            m_visibility(visibility_states::hidden),
+            m_active(false),
+            m_prev_width(params.client_width),
+            m_prev_height(params.client_height),
+            m_stats(new window_stats()),
+            m_commands(new details::command_queue<x11_window>()),
+            m_batching(false),
+            m_flush_pending(false),
+            m_published(new details::seqlock<window_state>(window_state{ params.client_width, params.client_height, 1.0f, false, visibility_states::hidden })),
+            m_has_randr(false),
+            m_randr_event_base(0),
+            m_outputs_valid(false),
+            m_fullscreen(false),
+            m_compositor_owner(None),
+            m_xi_opcode(0),
+            m_has_xi_touch(false),
+            m_pointer_x(0.0f),
+            m_pointer_y(0.0f)
         {
+            ACCEL_WINDOW_TRACE_SCOPE("x11_window::x11_window");
+
             m_display = XOpenDisplay(nullptr);
             if (!m_display)
                 throw std::runtime_error("Failed to open X display.");
@@ -26,21 +519,68 @@ namespace accel
             int background_color = BlackPixel(m_display, screen);
             m_window = XCreateSimpleWindow(m_display, root_window, 0, 0, params.client_width, params.client_height, 0, foreground_color, background_color);
             
-            m_event_mask = ExposureMask | PropertyChangeMask | KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask | StructureNotifyMask;
+            m_subscription = details::get_subscription(params);
+            m_event_mask = details::get_x11_event_mask(m_subscription);
             XSelectInput(m_display, m_window, m_event_mask);
 
+            // Without this the server sends each auto-repeat as a release and press pair
+            Bool detectable_repeat = False;
+            XkbSetDetectableAutoRepeat(m_display, True, &detectable_repeat);
+            window_stats::add(m_stats->round_trips);
+
+            // Smooth scrolling needs XInput 2.1 and touch 2.2. Pointer events then arrive through XI2, except during core grabs.
+            int xi_event_base = 0;
+            int xi_error_base = 0;
+            int xi_major = 2;
+            int xi_minor = 2;
+            if (XQueryExtension(m_display, "XInputExtension", &m_xi_opcode, &xi_event_base, &xi_error_base) && 
+                XIQueryVersion(m_display, &xi_major, &xi_minor) == Success && (xi_major > 2 || xi_minor >= 1))
+            {
+                m_has_xi_touch = xi_major > 2 || xi_minor >= 2;
+                select_xi_events();
+                update_scroll_valuators();
+            }
+            else
+            {
+                m_xi_opcode = 0;
+            }
+
+            // Output enumeration needs RandR 1.2 for CRTCs, without it no outputs are reported
+            int randr_error_base = 0;
+            int randr_major = 1;
+            int randr_minor = 2;
+            if (XRRQueryExtension(m_display, &m_randr_event_base, &randr_error_base) && XRRQueryVersion(m_display, &randr_major, &randr_minor))
+                m_has_randr = randr_major > 1 || randr_minor >= 2;
+
+            // The outputs are enumerated on first use, most windows never ask for them
+            if (m_has_randr)
+                XRRSelectInput(m_display, m_window, RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask | RROutputChangeNotifyMask);
+
             m_frame_atom = XInternAtom(m_display, "_NET_FRAME_EXTENTS", False);
             m_close_atom = XInternAtom(m_display, "WM_DELETE_WINDOW", False);
             m_hints_atom = XInternAtom(m_display, "_MOTIF_WM_HINTS", False);
 
+            // Fullscreen atoms are interned together in a single round trip
+            char compositor_selection[32];
+            std::snprintf(compositor_selection, sizeof(compositor_selection), "_NET_WM_CM_S%d", screen);
+            char* fullscreen_names[] = { const_cast<char*>("_NET_WM_STATE"), const_cast<char*>("_NET_WM_STATE_FULLSCREEN"), const_cast<char*>("_NET_WM_BYPASS_COMPOSITOR"), compositor_selection };
+            Atom fullscreen_atoms[4];
+            XInternAtoms(m_display, fullscreen_names, 4, False, fullscreen_atoms);
+            m_state_atom = fullscreen_atoms[0];
+            m_fullscreen_atom = fullscreen_atoms[1];
+            m_bypass_atom = fullscreen_atoms[2];
+            m_compositor_atom = fullscreen_atoms[3];
+
             XSetWMProtocols(m_display, m_window, &m_close_atom, True);
 
             set_title(params.title);
             set_style(params.style);
         }
 
-        ~window()
+        ~x11_window()
         {
+            m_capture.reset();
+
             if (m_window)
                 XDestroyWindow(m_display, m_window);
 
@@ -48,24 +588,20 @@ namespace accel
                 XCloseDisplay(m_display);
         }
 
-        window(const window&) = delete;
-        window& operator=(const window&) = delete;
+        x11_window(const x11_window&) = delete;
+        x11_window& operator=(const x11_window&) = delete;
 
-        window(window&&) = default;
-        window& operator=(window&&) = default;
+        x11_window(x11_window&&) = default;
+        x11_window& operator=(x11_window&&) = default;
 
         unsigned int get_client_width() const
         {
-            XWindowAttributes attributes;
-            XGetWindowAttributes(m_display, m_window, &attributes);
-            return attributes.width;
+            return get_attributes().width;
         }
 
         unsigned int get_client_height() const
         {
-            XWindowAttributes attributes;
-            XGetWindowAttributes(m_display, m_window, &attributes);
-            return attributes.height;
+            return get_attributes().height;
         }
 
         unsigned int get_width() const
@@ -88,30 +624,36 @@ namespace accel
 
         int get_x() const
         {
-            XWindowAttributes attributes;
-            XGetWindowAttributes(m_display, m_window, &attributes);
-            return attributes.x;
+            return get_attributes().x;
         }
 
         int get_y() const
         {
-            XWindowAttributes attributes;
-            XGetWindowAttributes(m_display, m_window, &attributes);
-            return attributes.y;
+            return get_attributes().y;
         }
 
         bool is_closing() const { return m_closing; }
         bool is_resizable() const { return m_style[window_style_bits::resizable]; }
         bool is_undecorated() const { return m_style[window_style_bits::undecorated]; }
-        bool is_hidden() const { return m_style[window_style_bits::undecorated]; }
+        bool is_hidden() const { return m_style[window_style_bits::hidden]; }
+        bool is_fullscreen() const { return m_fullscreen; }
         bool is_hiding_mouse() const { return m_style[window_style_bits::hide_mouse]; }
         bool is_trapping_mouse() const { return m_style[window_style_bits::trap_mouse]; }
         flagset<window_style_bits> get_style() const { return m_style; }
+        flagset<event_types> get_event_subscription() const { return m_subscription; }
+        visibility_states get_visibility() const { return m_visibility; }
+        bool is_occluded() const { return details::is_occluded(m_visibility); }
+        bool is_active() const { return m_active; }
+        bool is_key_down(unsigned int keycode) const { return m_input.is_key_down(keycode); }
+        bool is_button_down(mouse_buttons button) const { return m_input.is_button_down(button); }
+        input_state get_input_state() const { return m_input; }
+        const window_stats& stats() const { return *m_stats; }
         
         utf8::string get_title() const
         {
             XTextProperty text_property;
             XGetWMName(m_display, m_window, &text_property);
+            window_stats::add(m_stats->round_trips);
             utf8::string utf8_title(reinterpret_cast<char*>(text_property.value));
             XFree(text_property.value);
             return utf8_title;
@@ -125,13 +667,13 @@ namespace accel
                 throw std::runtime_error("Failed to create text property.");
             XSetWMName(m_display, m_window, &text_property);
             XFree(text_property.value);
-            XFlush(m_display);
+            flush();
         }
 
         void set_position(int x, int y)
         {
             XMoveWindow(m_display, m_window, x, y);
-            XFlush(m_display);
+            flush();
         }
 
         void set_size(unsigned int width, unsigned int height)
@@ -142,13 +684,13 @@ namespace accel
             unsigned int new_width = width - (frame[0] + frame[1]);
             unsigned int new_height = height - (frame[2] + frame[3]);
             XResizeWindow(m_display, m_window, new_width, new_height);
-            XFlush(m_display);
+            flush();
         }
 
         void set_client_size(unsigned int width, unsigned int height)
         {
             XResizeWindow(m_display, m_window, width, height);
-            XFlush(m_display);
+            flush();
         }
 
         void set_rect(int x, int y, unsigned int width, unsigned int height)
@@ -159,27 +701,10 @@ namespace accel
 
         void set_resizable(bool state)
         {
-            XSizeHints* sizeHints = XAllocSizeHints();
-
-            if (!state)
-            {
-                unsigned int width = get_client_width();
-                unsigned int height = get_client_height();
-
-                sizeHints->flags = PMinSize | PMaxSize;
-                sizeHints->min_width = width;
-                sizeHints->min_height = height;
-                sizeHints->max_width = width;
-                sizeHints->max_height = height;
-            }
-            
-            XSetWMNormalHints(m_display, m_window, sizeHints);
-            
-            XFree(sizeHints);
-
-            XFlush(m_display);
-
-            m_style.set(window_style_bits::resizable, state);
+            if (state)
+                set_size_hints(true, 0, 0);
+            else
+                set_size_hints(false, get_client_width(), get_client_height());
         }
 
         void set_undecorated(bool state)
@@ -197,11 +722,64 @@ namespace accel
             hints.decorations = state ? 0 : 1;
 
             XChangeProperty(m_display, m_window, m_hints_atom, m_hints_atom, 32, PropModeReplace, reinterpret_cast<unsigned char*>(&hints), 5);
-            XFlush(m_display);
+            flush();
             
             m_style.set(window_style_bits::undecorated, state);
         }
 
+        // Window managers fullscreen a window on the monitor it is on, so it is moved onto the chosen output first.
+        // An output_id of 0 or one get_outputs does not know keeps the current monitor.
+        void set_fullscreen(bool state, std::uint64_t output_id = 0)
+        {
+            if (output_id != 0)
+                ensure_outputs();
+
+            const output_info* output = details::find_output(m_outputs, output_id);
+            if (state && output)
+                XMoveWindow(m_display, m_window, output->x, output->y);
+
+            // 1 asks the compositor to unredirect the window, deleting it goes back to no preference
+            if (state)
+            {
+                long bypass = 1;
+                XChangeProperty(m_display, m_window, m_bypass_atom, XA_CARDINAL, 32, PropModeReplace, reinterpret_cast<unsigned char*>(&bypass), 1);
+            }
+            else
+            {
+                XDeleteProperty(m_display, m_window, m_bypass_atom);
+            }
+
+            if (m_style[window_style_bits::hidden])
+            {
+                // The window manager reads the initial state when the window gets mapped
+                set_initial_state(m_fullscreen_atom, state);
+            }
+            else
+            {
+                XEvent event{};
+                event.xclient.type = ClientMessage;
+                event.xclient.window = m_window;
+                event.xclient.message_type = m_state_atom;
+                event.xclient.format = 32;
+                event.xclient.data.l[0] = state ? 1 : 0;
+                event.xclient.data.l[1] = static_cast<long>(m_fullscreen_atom);
+                event.xclient.data.l[2] = 0;
+                event.xclient.data.l[3] = 1;
+                XSendEvent(m_display, DefaultRootWindow(m_display), False, SubstructureRedirectMask | SubstructureNotifyMask, &event);
+            }
+
+            flush();
+        }
+
+        // Without a compositing manager nothing composites a fullscreen window, with one the hint cannot be confirmed
+        compositor_bypass_states get_bypass_state() const
+        {
+            if (!m_fullscreen)
+                return compositor_bypass_states::inactive;
+
+            return m_compositor_owner == None ? compositor_bypass_states::granted : compositor_bypass_states::requested;
+        }
+
         void set_hidden(bool state)
         {
             if (state)
@@ -209,7 +787,7 @@ namespace accel
             else
                 XMapWindow(m_display, m_window);
             
-            XFlush(m_display);
+            flush();
 
             m_style.set(window_style_bits::hidden, state);
         }
@@ -221,7 +799,7 @@ namespace accel
             else
                 XUndefineCursor(m_display, m_window);
 
-            XFlush(m_display);
+            flush();
 
             m_style.set(window_style_bits::hide_mouse, state);
         }
@@ -233,23 +811,123 @@ namespace accel
             else
                 XUngrabPointer(m_display, CurrentTime);
 
-            XFlush(m_display);
+            flush();
 
             m_style.set(window_style_bits::trap_mouse, state);
         }
 
         void set_style(const flagset<window_style_bits>& style)
         {
+            ACCEL_WINDOW_TRACE_SCOPE("x11_window::set_style");
+
             set_resizable(style[window_style_bits::resizable]);
             set_undecorated(style[window_style_bits::undecorated]);
             set_hidden(style[window_style_bits::hidden]);
             set_hide_mouse(style[window_style_bits::hide_mouse]);
             set_trap_mouse(style[window_style_bits::trap_mouse]);
         }
+
+        // Applies the title, client size, style and subscription of params in one go, meant for reusing
+        // a hidden window. The requests share a single flush and the map request goes out last.
+        // Whatever the previous owner left queued is decoded and dropped, and its input, fullscreen,
+        // capture and statistics start over.
+        void retarget(const window_create_params& params)
+        {
+            ACCEL_WINDOW_TRACE_SCOPE("x11_window::retarget");
+
+            std::vector<generic_event> discarded;
+            poll_events(std::back_inserter(discarded));
+
+            m_input.clear();
+            m_repeat_keycode = 0;
+            m_motion_history.clear();
+            m_capture.reset();
+            m_stats->reset();
+
+            bool batching = m_batching;
+            m_batching = true;
+
+            set_fullscreen(false);
+            set_title(params.title);
+            set_event_subscription(details::get_subscription(params));
+            set_client_size(params.client_width, params.client_height);
+
+            // The target size is known, so fixing it needs no attribute query
+            set_size_hints(params.style[window_style_bits::resizable], params.client_width, params.client_height);
+            set_undecorated(params.style[window_style_bits::undecorated]);
+            set_hidden(params.style[window_style_bits::hidden]);
+            set_hide_mouse(params.style[window_style_bits::hide_mouse]);
+            set_trap_mouse(params.style[window_style_bits::trap_mouse]);
+
+            m_batching = batching;
+
+            if (m_flush_pending)
+                flush();
+        }
+
+        // Can be called from any thread, the command runs on the owning thread during its next poll_events
+        std::future<void> post(command_t command)
+        {
+            return m_commands->post(std::move(command));
+        }
+
+        // Can be called from any thread, reflects the events decoded by the last poll_events
+        window_state get_state() const
+        {
+            return m_published->load();
+        }
+
+        // X11 has no per-output scale, every output reports 1
+        std::vector<output_info> get_outputs() const
+        {
+            ensure_outputs();
+            return m_outputs;
+        }
+
+        // Outputs the mapped window overlaps, empty while hidden
+        std::vector<std::uint64_t> get_current_outputs() const
+        {
+            ensure_outputs();
+            return m_current_outputs;
+        }
+
+        // Every pointer position decoded by the last poll_events, oldest first. Only valid on the owning thread.
+        const std::vector<motion_sample>& get_motion_history() const { return m_motion_history; }
+
+        // Nothing stretches the client area here, the render scale always stays at 1
+        void set_render_scale(float)
+        {
+        }
+
+        float get_render_scale() const { return 1.0f; }
+
+        void set_event_subscription(const flagset<event_types>& events)
+        {
+            m_subscription = events;
+            m_event_mask = details::get_x11_event_mask(events);
+            XSelectInput(m_display, m_window, m_event_mask);
+            if (m_xi_opcode)
+                select_xi_events();
+            flush();
+        }
         
         template<typename ItT>
         void poll_events(ItT position_it)
         {
+            ACCEL_WINDOW_TRACE_SCOPE("x11_window::poll_events");
+
+            auto poll_start = std::chrono::steady_clock::now();
+
+            // Posted commands share a single flush
+            m_batching = true;
+            m_commands->apply(*this);
+            m_batching = false;
+
+            if (m_flush_pending)
+                flush();
+
+            m_motion_history.clear();
+
             XEvent event;
 
             // Close detection first to avoid processing unnecessary events
@@ -259,58 +937,211 @@ namespace accel
                     m_closing = true;
             }
 
-            std::vector<generic_event> polled_events;   
-            while (XCheckWindowEvent(m_display, m_window, m_event_mask, &event)) 
+            // Layout changes usually come in bursts, the outputs are enumerated again once per poll
+            bool layout_changed = false;
+            if (m_has_randr)
+            {
+                while (XCheckTypedWindowEvent(m_display, m_window, m_randr_event_base + RRScreenChangeNotify, &event))
+                {
+                    XRRUpdateConfiguration(&event);
+                    layout_changed = true;
+                }
+
+                while (XCheckTypedWindowEvent(m_display, m_window, m_randr_event_base + RRNotify, &event))
+                    layout_changed = true;
+            }
+
+            bool resized = false;
+            bool moved = false;
+            bool wm_state_changed = false;
+            while (XCheckIfEvent(m_display, &event, &x11_window::is_polled_event, reinterpret_cast<XPointer>(this))) 
             {    
                 switch (event.type)
                 {
                     case KeyPress:
-                        polled_events.emplace_back(key_down_event{ event.xkey.keycode });
+                    {
+                        // The server only auto-repeats the key pressed last, and with detectable auto-repeat
+                        // its repeats are presses without a release in between
+                        bool repeat = event.xkey.keycode == m_repeat_keycode;
+                        m_repeat_keycode = event.xkey.keycode;
+                        m_input.set_key(event.xkey.keycode, true);
+                        emit(key_down_event{ event.xkey.keycode, repeat });
                         break;
+                    }
                     
                     case KeyRelease:
-                        polled_events.emplace_back(key_up_event{ event.xkey.keycode });
+                        if (event.xkey.keycode == m_repeat_keycode)
+                            m_repeat_keycode = 0;
+                        m_input.set_key(event.xkey.keycode, false);
+                        emit(key_up_event{ event.xkey.keycode });
                         break;
 
                     case ButtonPress:
-                        if (event.xbutton.button < 4)
-                            polled_events.emplace_back(mouse_down_event{ static_cast<mouse_buttons>(event.xbutton.button), event.xbutton.x, event.xbutton.y });
-                        else if (event.xbutton.button == 4)
-                            polled_events.emplace_back(mouse_scroll_event{ event.xbutton.x, event.xbutton.y, mouse_scroll_directions::up });
-                        else if (event.xbutton.button == 5)
-                            polled_events.emplace_back(mouse_scroll_event{ event.xbutton.x, event.xbutton.y, mouse_scroll_directions::down });
+                    case ButtonRelease:
+                        handle_button(event.xbutton.button, event.type == ButtonPress, event.xbutton.x, event.xbutton.y);
                         break;
 
-                    case ButtonRelease:
-                        polled_events.emplace_back(mouse_up_event{ static_cast<mouse_buttons>(event.xbutton.button), event.xbutton.x, event.xbutton.y });
+                    case GenericEvent:
+                        handle_xi_event(event);
+                        break;
+
+                    case FocusIn:
+                    case FocusOut:
+                    {
+                        bool active = event.type == FocusIn;
+
+                        // Releases that happen while unfocused are never delivered to us
+                        if (!active)
+                        {
+                            m_input.clear();
+                            m_repeat_keycode = 0;
+                        }
+
+                        // Grab transitions and focus moving between our own subwindows are not activation changes
+                        if (event.xfocus.mode == NotifyGrab || event.xfocus.mode == NotifyUngrab || event.xfocus.detail == NotifyInferior)
+                            break;
+
+                        if (active != m_active)
+                        {
+                            m_active = active;
+                            publish_state();
+                            emit(activate_event{ active });
+                        }
+                        break;
+                    }
+
+                    case VisibilityNotify:
+                        if (event.xvisibility.state == VisibilityUnobscured)
+                            set_visibility(visibility_states::visible);
+                        else if (event.xvisibility.state == VisibilityPartiallyObscured)
+                            set_visibility(visibility_states::partially_occluded);
+                        else
+                            set_visibility(visibility_states::occluded);
+                        break;
+
+                    case Expose:
+                    {
+                        const XExposeEvent& expose = event.xexpose;
+                        m_damage.add(rect{ expose.x, expose.y, static_cast<unsigned int>(expose.width), static_cast<unsigned int>(expose.height) });
+
+                        // The server sends exposures in a series, count is the number still to come
+                        if (expose.count == 0)
+                            emit(m_damage.take());
+                        else
+                            window_stats::add(m_stats->events_coalesced);
+                        break;
+                    }
+
+                    case MapNotify:
+                        // A VisibilityNotify with the real occlusion state follows the map
+                        set_visibility(visibility_states::visible);
+                        moved = true;
+                        wm_state_changed = true;
+                        break;
+
+                    case UnmapNotify:
+                        set_visibility(visibility_states::hidden);
+                        moved = true;
+                        wm_state_changed = true;
+                        break;
+
+                    case PropertyNotify:
+                        if (event.xproperty.atom == m_state_atom)
+                            wm_state_changed = true;
                         break;
 
                     case MotionNotify:
-                        polled_events.emplace_back(mouse_move_event{ event.xmotion.x, event.xmotion.y });
+                        m_pointer_x = static_cast<float>(event.xmotion.x);
+                        m_pointer_y = static_cast<float>(event.xmotion.y);
+                        m_motion_history.push_back(motion_sample{ static_cast<std::uint32_t>(event.xmotion.time), m_pointer_x, m_pointer_y });
+                        emit(mouse_move_event{ event.xmotion.x, event.xmotion.y });
                         break;
 
                     case ConfigureNotify:
-                        if (event.xconfigure.width != m_prev_width || event.xconfigure.height != m_prev_height)
-                        {
-                            std::array<long, 4> frame;
-                            get_frame(frame);
+                        moved = true;
 
-                            unsigned int client_width = static_cast<unsigned int>(event.xconfigure.width + frame[0] + frame[1]);
-                            unsigned int client_height = static_cast<unsigned int>(frame[2] + frame[3]);
-                            unsigned int width = static_cast<unsigned int>(event.xconfigure.width);
-                            unsigned int height = static_cast<unsigned int>(event.xconfigure.height);
+                        if (event.xconfigure.width != static_cast<int>(m_prev_width) || event.xconfigure.height != static_cast<int>(m_prev_height))
+                        {
+                            // Only the last size of a burst is reported, which also keeps it to one frame query per poll
+                            if (resized)
+                                window_stats::add(m_stats->events_coalesced);
 
-                            polled_events.emplace_back(resize_event{ client_width, client_height, width, height });
+                            resized = true;
+                            m_prev_width = static_cast<unsigned int>(event.xconfigure.width);
+                            m_prev_height = static_cast<unsigned int>(event.xconfigure.height);
                         }
                         break;
                 }
             }
 
-            std::copy(polled_events.begin(), polled_events.end(), position_it);
+            if (resized)
+                publish_state();
+
+            if (wm_state_changed)
+                update_fullscreen();
+
+            if (!m_scroll.empty())
+            {
+                if (m_scroll.count() > 1)
+                    window_stats::add(m_stats->events_coalesced, m_scroll.count() - 1);
+                emit(m_scroll.take());
+            }
+
+            if (!m_touch.empty())
+                emit_touch();
+
+            if (layout_changed)
+                update_outputs();
+            else if (moved && m_has_randr)
+                update_current_outputs();
+
+            // Skip the frame query when nobody wants the event, structure notifications are always selected
+            if (resized && !m_subscription[event_types::resize])
+            {
+                m_stats->add_event(event_types::resize, true);
+            }
+            else if (resized)
+            {
+                std::array<long, 4> frame = {};
+                get_frame(frame);
+
+                unsigned int width = static_cast<unsigned int>(m_prev_width + frame[0] + frame[1]);
+                unsigned int height = static_cast<unsigned int>(m_prev_height + frame[2] + frame[3]);
+                emit(resize_event{ width, height, m_prev_width, m_prev_height });
+            }
+
+            std::copy(m_polled_events.cbegin(), m_polled_events.cend(), position_it);
+
+            m_polled_events.clear();
+
+            m_stats->add_poll(std::chrono::steady_clock::now() - poll_start);
         }
 
         native_handle_t get_platform_handle() const { return std::make_pair(m_display, m_window); }
 
+        // Readable when poll_events has something to decode. Xlib may already hold events read during
+        // other requests, so poll once before blocking on it.
+        std::vector<int> get_event_fds() const { return { ConnectionNumber(m_display) }; }
+
+        // X11 has no frame callbacks, callers pace frames themselves
+        bool request_frame() { return false; }
+        bool take_frame() { return false; }
+
+        // Reads the window back through MIT-SHM into an image reused by later captures. With an area only its rows
+        // are read again. The window has to be viewable, parts of it outside the screen are not read.
+        capture_image capture() { return capture_area(nullptr); }
+        capture_image capture(const rect& area) { return capture_area(&area); }
+
+        // With continuous capture on, capture() reads back only what XDamage reported since the previous capture
+        void set_continuous_capture(bool state)
+        {
+            if (!m_capture)
+                m_capture.reset(new details::x11_capture(m_display, m_window, *m_stats));
+            m_capture->set_continuous(state);
+        }
+
+        bool is_continuous_capture() const { return m_capture && m_capture->is_continuous(); }
+
     private:
         Display* m_display;
         Window m_window;
@@ -318,20 +1149,521 @@ namespace accel
         Atom m_close_atom;
         Atom m_frame_atom;
         Atom m_hints_atom;
+        Atom m_state_atom;
+        Atom m_fullscreen_atom;
+        Atom m_bypass_atom;
+        Atom m_compositor_atom;
 
         long m_event_mask;
+        flagset<event_types> m_subscription;
+        std::vector<generic_event> m_polled_events;
         bool m_closing;
         flagset<window_style_bits> m_style;
+        input_state m_input;
+        unsigned int m_repeat_keycode;
+        visibility_states m_visibility;
+        bool m_active;
+        details::damage_region m_damage;
 
         unsigned int m_prev_width;
         unsigned int m_prev_height;
 
+        std::unique_ptr<window_stats> m_stats;
+        std::unique_ptr<details::command_queue<x11_window>> m_commands;
+        bool m_batching;
+        bool m_flush_pending;
+        std::unique_ptr<details::seqlock<window_state>> m_published;
+
+        bool m_has_randr;
+        int m_randr_event_base;
+        mutable std::vector<output_info> m_outputs;
+        mutable std::vector<std::uint64_t> m_current_outputs;
+        mutable bool m_outputs_valid;
+
+        // XI2 and core motion reach us uncompressed, so the event stream already holds every sample
+        // the server's motion buffer would return through XGetMotionEvents
+        std::vector<motion_sample> m_motion_history;
+
+        std::unique_ptr<details::x11_capture> m_capture;
+
+        capture_image capture_area(const rect* area)
+        {
+            XWindowAttributes attributes = get_attributes();
+            if (attributes.map_state != IsViewable)
+                throw std::runtime_error("Cannot capture a window that is not viewable.");
+
+            if (!m_capture)
+                m_capture.reset(new details::x11_capture(m_display, m_window, *m_stats));
+            return m_capture->capture(attributes, area);
+        }
+        bool m_fullscreen;
+        Window m_compositor_owner;
+
+        int m_xi_opcode;
+        bool m_has_xi_touch;
+        details::touch_accumulator m_touch;
+        std::vector<details::x11_scroll_valuator> m_scroll_valuators;
+        details::scroll_accumulator m_scroll;
+        float m_pointer_x;
+        float m_pointer_y;
+
+        // Core events for the window and XI2 events. Client messages and RandR events are read on their own.
+        static Bool is_polled_event(Display*, XEvent* event, XPointer arg)
+        {
+            auto self = reinterpret_cast<x11_window*>(arg);
+            if (event->type == GenericEvent)
+                return self->m_xi_opcode != 0 && event->xcookie.extension == self->m_xi_opcode;
+
+            return event->xany.window == self->m_window && event->type < LASTEvent && event->type != ClientMessage;
+        }
+
+        void select_xi_events()
+        {
+            unsigned char mask[XIMaskLen(XI_LASTEVENT)] = {};
+
+            if (m_subscription[event_types::mouse_down] || m_subscription[event_types::mouse_up] || 
+                m_subscription[event_types::mouse_move] || m_subscription[event_types::mouse_scroll])
+            {
+                XISetMask(mask, XI_Motion);
+                XISetMask(mask, XI_ButtonPress);
+                XISetMask(mask, XI_ButtonRelease);
+                XISetMask(mask, XI_Enter);
+                XISetMask(mask, XI_DeviceChanged);
+            }
+
+            // Selecting touch events stops the server from emulating pointer events for them
+            if (m_has_xi_touch && m_subscription[event_types::touch])
+            {
+                XISetMask(mask, XI_TouchBegin);
+                XISetMask(mask, XI_TouchUpdate);
+                XISetMask(mask, XI_TouchEnd);
+            }
+
+            XIEventMask event_mask;
+            event_mask.deviceid = XIAllMasterDevices;
+            event_mask.mask_len = sizeof(mask);
+            event_mask.mask = mask;
+            XISelectEvents(m_display, m_window, &event_mask, 1);
+        }
+
+        // Master pointer events carry the valuators of the slave device that sent them
+        void update_scroll_valuators()
+        {
+            m_scroll_valuators.clear();
+
+            int count = 0;
+            XIDeviceInfo* devices = XIQueryDevice(m_display, XIAllDevices, &count);
+            window_stats::add(m_stats->round_trips);
+            if (!devices)
+                return;
+
+            for (int i = 0; i < count; i++)
+            {
+                for (int j = 0; j < devices[i].num_classes; j++)
+                {
+                    if (devices[i].classes[j]->type != XIScrollClass)
+                        continue;
+
+                    auto scroll = reinterpret_cast<const XIScrollClassInfo*>(devices[i].classes[j]);
+                    m_scroll_valuators.push_back(details::x11_scroll_valuator{ devices[i].deviceid, scroll->number, scroll->scroll_type == XIScrollTypeVertical, scroll->increment, 0.0, false });
+                }
+            }
+
+            XIFreeDeviceInfo(devices);
+        }
+
+        // Valuators scrolling down and right count up
+        bool get_scroll_deltas(const XIDeviceEvent& event, float& delta_x, float& delta_y)
+        {
+            bool scrolled = false;
+            const double* value = event.valuators.values;
+
+            for (int i = 0; i < event.valuators.mask_len * 8; i++)
+            {
+                if (!XIMaskIsSet(event.valuators.mask, i))
+                    continue;
+
+                for (details::x11_scroll_valuator& valuator : m_scroll_valuators)
+                {
+                    if (valuator.device != event.sourceid || valuator.number != i)
+                        continue;
+
+                    if (valuator.has_last && valuator.increment != 0.0)
+                    {
+                        float delta = static_cast<float>((*value - valuator.last) / valuator.increment);
+                        if (valuator.vertical)
+                            delta_y -= delta;
+                        else
+                            delta_x += delta;
+                        scrolled = true;
+                    }
+
+                    valuator.last = *value;
+                    valuator.has_last = true;
+                }
+
+                value++;
+            }
+
+            return scrolled;
+        }
+
+        // Buttons 4 to 7 are wheel notches up, down, left and right
+        void handle_button(unsigned int x11_button, bool pressed, int x, int y)
+        {
+            mouse_buttons button;
+            if (details::from_x11_button(x11_button, button))
+            {
+                m_input.set_button(button, pressed);
+                if (pressed)
+                    emit(mouse_down_event{ button, x, y });
+                else
+                    emit(mouse_up_event{ button, x, y });
+            }
+            else if (pressed)
+            {
+                switch (x11_button)
+                {
+                    case Button4: m_scroll.add(x, y, 0.0f, 1.0f); break;
+                    case Button5: m_scroll.add(x, y, 0.0f, -1.0f); break;
+                    case 6: m_scroll.add(x, y, -1.0f, 0.0f); break;
+                    case 7: m_scroll.add(x, y, 1.0f, 0.0f); break;
+                }
+            }
+        }
+
+        // X11 has no touch frames, everything decoded by one poll counts as one
+        void add_touch(std::int32_t id, touch_phases phase, float x, float y)
+        {
+            if (m_touch.full())
+                emit_touch();
+            m_touch.add(id, phase, x, y);
+        }
+
+        void emit_touch()
+        {
+            window_stats::add(m_stats->events_coalesced, m_touch.coalesced());
+            emit(m_touch.take());
+        }
+
+        void handle_xi_event(XEvent& event)
+        {
+            if (!XGetEventData(m_display, &event.xcookie))
+                return;
+
+            switch (event.xcookie.evtype)
+            {
+                case XI_Motion:
+                {
+                    auto device_event = static_cast<const XIDeviceEvent*>(event.xcookie.data);
+                    int x = static_cast<int>(device_event->event_x);
+                    int y = static_cast<int>(device_event->event_y);
+
+                    float delta_x = 0.0f;
+                    float delta_y = 0.0f;
+                    if (get_scroll_deltas(*device_event, delta_x, delta_y))
+                        m_scroll.add(x, y, delta_x, delta_y);
+
+                    // Scrolling alone also produces motion events. The history keeps sub-pixel steps,
+                    // mouse_move only reports whole pixels.
+                    float sample_x = static_cast<float>(device_event->event_x);
+                    float sample_y = static_cast<float>(device_event->event_y);
+                    if (sample_x != m_pointer_x || sample_y != m_pointer_y)
+                    {
+                        bool moved = x != static_cast<int>(m_pointer_x) || y != static_cast<int>(m_pointer_y);
+                        m_pointer_x = sample_x;
+                        m_pointer_y = sample_y;
+                        m_motion_history.push_back(motion_sample{ static_cast<std::uint32_t>(device_event->time), sample_x, sample_y });
+                        if (moved)
+                            emit(mouse_move_event{ x, y });
+                    }
+                    break;
+                }
+
+                case XI_ButtonPress:
+                case XI_ButtonRelease:
+                {
+                    auto device_event = static_cast<const XIDeviceEvent*>(event.xcookie.data);
+
+                    // Wheel clicks emulated from smooth scrolling were already counted through the valuators
+                    if (device_event->flags & XIPointerEmulated)
+                        break;
+
+                    handle_button(static_cast<unsigned int>(device_event->detail), event.xcookie.evtype == XI_ButtonPress, 
+                        static_cast<int>(device_event->event_x), static_cast<int>(device_event->event_y));
+                    break;
+                }
+
+                // Valuators keep counting while the pointer is elsewhere, the next motion sets a new baseline
+                case XI_Enter:
+                    for (details::x11_scroll_valuator& valuator : m_scroll_valuators)
+                        valuator.has_last = false;
+                    break;
+
+                case XI_DeviceChanged:
+                    update_scroll_valuators();
+                    break;
+
+                case XI_TouchBegin:
+                case XI_TouchUpdate:
+                case XI_TouchEnd:
+                {
+                    auto device_event = static_cast<const XIDeviceEvent*>(event.xcookie.data);
+
+                    touch_phases phase = touch_phases::motion;
+                    if (event.xcookie.evtype == XI_TouchBegin)
+                        phase = touch_phases::down;
+                    else if (event.xcookie.evtype == XI_TouchEnd)
+                        phase = touch_phases::up;
+
+                    add_touch(static_cast<std::int32_t>(device_event->detail), phase, static_cast<float>(device_event->event_x), static_cast<float>(device_event->event_y));
+                    break;
+                }
+            }
+
+            XFreeEventData(m_display, &event.xcookie);
+        }
+
+        void publish_state()
+        {
+            m_published->store(window_state{ m_prev_width, m_prev_height, 1.0f, m_active, m_visibility });
+        }
+
+        // The first enumeration asked for through get_outputs reports no events, the caller gets the whole list.
+        // One caused by a layout change reports every output as added when nothing was enumerated before.
+        void ensure_outputs() const
+        {
+            if (!m_has_randr || m_outputs_valid)
+                return;
+
+            read_outputs(m_outputs);
+            m_current_outputs = read_current_outputs();
+            m_outputs_valid = true;
+        }
+
+        void update_outputs()
+        {
+            std::vector<output_info> outputs;
+            read_outputs(outputs);
+
+            details::diff_outputs(m_outputs, outputs, [this](output_event&& event) { emit(std::move(event)); });
+            m_outputs.swap(outputs);
+            m_outputs_valid = true;
+
+            update_current_outputs();
+        }
+
+        // Every CRTC that drives at least one output counts as an output, clones share it
+        void read_outputs(std::vector<output_info>& outputs) const
+        {
+            ACCEL_WINDOW_TRACE_SCOPE("x11_window::read_outputs");
+
+            outputs.clear();
+
+            XRRScreenResources* resources = XRRGetScreenResourcesCurrent(m_display, DefaultRootWindow(m_display));
+            window_stats::add(m_stats->round_trips);
+            if (!resources)
+                return;
+
+            for (int i = 0; i < resources->ncrtc; i++)
+            {
+                XRRCrtcInfo* crtc = XRRGetCrtcInfo(m_display, resources, resources->crtcs[i]);
+                window_stats::add(m_stats->round_trips);
+                if (!crtc)
+                    continue;
+
+                if (crtc->mode != None && crtc->noutput > 0)
+                {
+                    output_info output{};
+                    output.id = crtc->outputs[0];
+                    output.x = crtc->x;
+                    output.y = crtc->y;
+                    output.width = crtc->width;
+                    output.height = crtc->height;
+                    output.scale = 1.0f;
+                    output.refresh_mhz = details::get_x11_refresh_mhz(resources, crtc->mode);
+
+                    XRROutputInfo* info = XRRGetOutputInfo(m_display, resources, crtc->outputs[0]);
+                    window_stats::add(m_stats->round_trips);
+                    if (info)
+                    {
+                        output.name = utf8::string(info->name);
+                        XRRFreeOutputInfo(info);
+                    }
+
+                    outputs.push_back(output);
+                }
+
+                XRRFreeCrtcInfo(crtc);
+            }
+
+            XRRFreeScreenResources(resources);
+        }
+
+        // Nothing to track until the outputs have been enumerated
+        void update_current_outputs()
+        {
+            if (!m_outputs_valid)
+                return;
+
+            std::vector<std::uint64_t> current = read_current_outputs();
+            details::diff_current_outputs(m_current_outputs, current, [this](output_event&& event) { emit(std::move(event)); });
+            m_current_outputs.swap(current);
+        }
+
+        // ConfigureNotify positions are relative to the window manager frame, so the root position is asked for
+        std::vector<std::uint64_t> read_current_outputs() const
+        {
+            if (m_visibility == visibility_states::hidden)
+                return std::vector<std::uint64_t>();
+
+            int x = 0;
+            int y = 0;
+            Window child;
+            XTranslateCoordinates(m_display, m_window, DefaultRootWindow(m_display), 0, 0, &x, &y, &child);
+            window_stats::add(m_stats->round_trips);
+
+            return details::get_overlapping_outputs(m_outputs, rect{ x, y, m_prev_width, m_prev_height });
+        }
+
+        void emit(generic_event&& event)
+        {
+            bool subscribed = m_subscription[event.type];
+            m_stats->add_event(event.type, !subscribed);
+
+            if (subscribed)
+                m_polled_events.emplace_back(std::move(event));
+        }
+
+        void flush()
+        {
+            if (m_batching)
+            {
+                m_flush_pending = true;
+                return;
+            }
+
+            m_flush_pending = false;
+            XFlush(m_display);
+            window_stats::add(m_stats->flushes);
+        }
+
+        void set_size_hints(bool resizable, unsigned int width, unsigned int height)
+        {
+            XSizeHints* sizeHints = XAllocSizeHints();
+
+            if (!resizable)
+            {
+                sizeHints->flags = PMinSize | PMaxSize;
+                sizeHints->min_width = width;
+                sizeHints->min_height = height;
+                sizeHints->max_width = width;
+                sizeHints->max_height = height;
+            }
+            
+            XSetWMNormalHints(m_display, m_window, sizeHints);
+            
+            XFree(sizeHints);
+
+            flush();
+
+            m_style.set(window_style_bits::resizable, resizable);
+        }
+
+        XWindowAttributes get_attributes() const
+        {
+            XWindowAttributes attributes;
+            XGetWindowAttributes(m_display, m_window, &attributes);
+            window_stats::add(m_stats->round_trips);
+            return attributes;
+        }
+
+        void set_visibility(visibility_states visibility)
+        {
+            if (visibility == m_visibility)
+                return;
+
+            m_visibility = visibility;
+            publish_state();
+            emit(visibility_event{ visibility });
+        }
+
+        // Only the window manager puts a window into fullscreen, which it reports through _NET_WM_STATE once the
+        // window is mapped. Our own write to the property while hidden is a request and does not count.
+        void update_fullscreen()
+        {
+            const bool was_fullscreen = m_fullscreen;
+            read_fullscreen();
+
+            // The compositor is looked up once per fullscreen change so get_bypass_state stays free of round trips
+            if (m_fullscreen && !was_fullscreen)
+            {
+                m_compositor_owner = XGetSelectionOwner(m_display, m_compositor_atom);
+                window_stats::add(m_stats->round_trips);
+            }
+        }
+
+        void read_fullscreen()
+        {
+            m_fullscreen = false;
+            if (m_visibility == visibility_states::hidden)
+                return;
+
+            Atom actual_type;
+            int actual_format;
+            unsigned long item_count, bytes_after;
+            unsigned char* prop_value = nullptr;
+            window_stats::add(m_stats->round_trips);
+            if (XGetWindowProperty(m_display, m_window, m_state_atom, 0, 32, False, XA_ATOM, &actual_type, &actual_format, &item_count, &bytes_after, &prop_value) != Success)
+                return;
+
+            if (actual_type == XA_ATOM && actual_format == 32)
+            {
+                const Atom* states = reinterpret_cast<const Atom*>(prop_value);
+                m_fullscreen = std::find(states, states + item_count, m_fullscreen_atom) != states + item_count;
+            }
+
+            XFree(prop_value);
+        }
+
+        // Adds or removes a single _NET_WM_STATE entry, keeping any other state already requested
+        void set_initial_state(Atom entry, bool state)
+        {
+            std::vector<Atom> states;
+
+            Atom actual_type;
+            int actual_format;
+            unsigned long item_count, bytes_after;
+            unsigned char* prop_value = nullptr;
+            window_stats::add(m_stats->round_trips);
+            if (XGetWindowProperty(m_display, m_window, m_state_atom, 0, 32, False, XA_ATOM, &actual_type, &actual_format, &item_count, &bytes_after, &prop_value) == Success)
+            {
+                if (actual_type == XA_ATOM && actual_format == 32)
+                {
+                    const Atom* current = reinterpret_cast<const Atom*>(prop_value);
+                    states.assign(current, current + item_count);
+                }
+
+                XFree(prop_value);
+            }
+
+            states.erase(std::remove(states.begin(), states.end(), entry), states.end());
+            if (state)
+                states.push_back(entry);
+
+            if (states.empty())
+                XDeleteProperty(m_display, m_window, m_state_atom);
+            else
+                XChangeProperty(m_display, m_window, m_state_atom, XA_ATOM, 32, PropModeReplace, reinterpret_cast<unsigned char*>(states.data()), static_cast<int>(states.size()));
+        }
+
         bool get_frame(std::array<long, 4>& values) const
         {
             Atom actual_type;
             int actual_format;
             unsigned long item_count, bytes_after;
             unsigned char* prop_value = nullptr;
+            window_stats::add(m_stats->round_trips);
             if (!XGetWindowProperty(m_display, m_window, m_frame_atom, 0, 4, False, AnyPropertyType, &actual_type, &actual_format, &item_count, &bytes_after, &prop_value) == Success)
                 return false;
             
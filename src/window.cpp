@@ -0,0 +1,131 @@
+#define ACCEL_WINDOW_BUILDING
+#include <accel/window>
+
+namespace accel
+{
+    namespace
+    {
+#if defined(PLATFORM_WINDOWS)
+        void* get_native_display(win32_window& backend) { return nullptr; }
+        void* get_native_surface(win32_window& backend) { return backend.get_platform_handle(); }
+#else
+    #ifdef USE_X11
+        void* get_native_display(x11_window& backend) { return backend.get_platform_handle().first; }
+        void* get_native_surface(x11_window& backend) { return reinterpret_cast<void*>(static_cast<std::uintptr_t>(backend.get_platform_handle().second)); }
+    #endif
+
+    #if !defined(USE_X11) || defined(USE_WAYLAND)
+        void* get_native_display(wayland_window& backend) { return backend.get_platform_handle().display; }
+        void* get_native_surface(wayland_window& backend) { return backend.get_platform_handle().surf; }
+    #endif
+
+    #if defined(USE_X11) && defined(USE_WAYLAND)
+        void* get_native_display(runtime_window& backend)
+        {
+            if (wayland_window* wayland = backend.get_wayland_window())
+                return get_native_display(*wayland);
+            return get_native_display(*backend.get_x11_window());
+        }
+
+        void* get_native_surface(runtime_window& backend)
+        {
+            if (wayland_window* wayland = backend.get_wayland_window())
+                return get_native_surface(*wayland);
+            return get_native_surface(*backend.get_x11_window());
+        }
+    #endif
+#endif
+    }
+
+    struct window::impl
+    {
+        platform_window backend;
+        details::command_queue<window> commands;
+
+        impl(const window_create_params& params) : backend(params) {}
+    };
+
+    window::window(const window_create_params& params) :
+        m_impl(new impl(params))
+    {
+    }
+
+    window::~window() = default;
+
+    window::window(window&&) noexcept = default;
+    window& window::operator=(window&&) noexcept = default;
+
+    unsigned int window::get_client_width() const { return m_impl->backend.get_client_width(); }
+    unsigned int window::get_client_height() const { return m_impl->backend.get_client_height(); }
+    unsigned int window::get_width() const { return m_impl->backend.get_width(); }
+    unsigned int window::get_height() const { return m_impl->backend.get_height(); }
+    int window::get_x() const { return m_impl->backend.get_x(); }
+    int window::get_y() const { return m_impl->backend.get_y(); }
+
+    bool window::is_closing() const { return m_impl->backend.is_closing(); }
+    bool window::is_resizable() const { return m_impl->backend.is_resizable(); }
+    bool window::is_undecorated() const { return m_impl->backend.is_undecorated(); }
+    bool window::is_hidden() const { return m_impl->backend.is_hidden(); }
+    bool window::is_fullscreen() const { return m_impl->backend.is_fullscreen(); }
+    bool window::is_hiding_mouse() const { return m_impl->backend.is_hiding_mouse(); }
+    bool window::is_trapping_mouse() const { return m_impl->backend.is_trapping_mouse(); }
+    flagset<window_style_bits> window::get_style() const { return m_impl->backend.get_style(); }
+    flagset<event_types> window::get_event_subscription() const { return m_impl->backend.get_event_subscription(); }
+    visibility_states window::get_visibility() const { return m_impl->backend.get_visibility(); }
+    bool window::is_occluded() const { return m_impl->backend.is_occluded(); }
+    bool window::is_active() const { return m_impl->backend.is_active(); }
+    bool window::is_key_down(unsigned int keycode) const { return m_impl->backend.is_key_down(keycode); }
+    bool window::is_button_down(mouse_buttons button) const { return m_impl->backend.is_button_down(button); }
+    input_state window::get_input_state() const { return m_impl->backend.get_input_state(); }
+    const window_stats& window::stats() const { return m_impl->backend.stats(); }
+    window_state window::get_state() const { return m_impl->backend.get_state(); }
+
+    utf8::string window::get_title() const { return m_impl->backend.get_title(); }
+    void window::set_title(const utf8::string& title) { m_impl->backend.set_title(title); }
+    void window::set_position(int x, int y) { m_impl->backend.set_position(x, y); }
+    void window::set_size(unsigned int width, unsigned int height) { m_impl->backend.set_size(width, height); }
+    void window::set_client_size(unsigned int width, unsigned int height) { m_impl->backend.set_client_size(width, height); }
+    void window::set_rect(int x, int y, unsigned int width, unsigned int height) { m_impl->backend.set_rect(x, y, width, height); }
+    void window::set_resizable(bool state) { m_impl->backend.set_resizable(state); }
+    void window::set_undecorated(bool state) { m_impl->backend.set_undecorated(state); }
+    void window::set_hidden(bool state) { m_impl->backend.set_hidden(state); }
+    void window::set_fullscreen(bool state, std::uint64_t output_id) { m_impl->backend.set_fullscreen(state, output_id); }
+    compositor_bypass_states window::get_bypass_state() const { return m_impl->backend.get_bypass_state(); }
+    void window::set_hide_mouse(bool state) { m_impl->backend.set_hide_mouse(state); }
+    void window::set_trap_mouse(bool state) { m_impl->backend.set_trap_mouse(state); }
+    void window::set_style(const flagset<window_style_bits>& style) { m_impl->backend.set_style(style); }
+    void window::set_event_subscription(const flagset<event_types>& events) { m_impl->backend.set_event_subscription(events); }
+    void window::retarget(const window_create_params& params) { m_impl->backend.retarget(params); }
+    void window::set_render_scale(float scale) { m_impl->backend.set_render_scale(scale); }
+    float window::get_render_scale() const { return m_impl->backend.get_render_scale(); }
+    std::vector<output_info> window::get_outputs() const { return m_impl->backend.get_outputs(); }
+    std::vector<std::uint64_t> window::get_current_outputs() const { return m_impl->backend.get_current_outputs(); }
+    const std::vector<motion_sample>& window::get_motion_history() const { return m_impl->backend.get_motion_history(); }
+
+    std::future<void> window::post(command_t command)
+    {
+        return m_impl->commands.post(std::move(command));
+    }
+
+    void* window::get_native_display() const { return accel::get_native_display(m_impl->backend); }
+    void* window::get_native_surface() const { return accel::get_native_surface(m_impl->backend); }
+
+#if !defined(PLATFORM_WINDOWS)
+    std::vector<int> window::get_event_fds() const { return m_impl->backend.get_event_fds(); }
+    bool window::request_frame() { return m_impl->backend.request_frame(); }
+    bool window::take_frame() { return m_impl->backend.take_frame(); }
+#endif
+
+#if defined(USE_X11)
+    capture_image window::capture() { return m_impl->backend.capture(); }
+    capture_image window::capture(const rect& area) { return m_impl->backend.capture(area); }
+    void window::set_continuous_capture(bool state) { m_impl->backend.set_continuous_capture(state); }
+    bool window::is_continuous_capture() const { return m_impl->backend.is_continuous_capture(); }
+#endif
+
+    void window::poll_batch()
+    {
+        m_impl->commands.apply(*this);
+        m_impl->backend.poll_events(std::back_inserter(m_events));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <accel/window>
+
+using namespace accel;
+
+// Runs without a display, exercises the cross-thread pieces windows are built from
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
+
+// Stands in for a window, only the owning thread touches it
+struct command_target
+{
+    std::vector<std::vector<unsigned int>> applied;
+};
+
+// Several producers post while the owner applies. Every command runs exactly once and
+// the commands of one producer run in the order it posted them.
+static void test_command_queue()
+{
+    const unsigned int producer_count = 4;
+    const unsigned int commands_per_producer = 20000;
+
+    details::command_queue<command_target> queue;
+    command_target target;
+    target.applied.resize(producer_count);
+
+    std::vector<std::vector<std::future<void>>> futures(producer_count);
+    std::atomic<unsigned int> producers_done(0);
+
+    std::vector<std::thread> producers;
+    for (unsigned int producer = 0; producer < producer_count; producer++)
+    {
+        producers.emplace_back([&, producer]()
+        {
+            futures[producer].reserve(commands_per_producer);
+            for (unsigned int i = 0; i < commands_per_producer; i++)
+                futures[producer].push_back(queue.post([producer, i](command_target& owner) { owner.applied[producer].push_back(i); }));
+
+            producers_done.fetch_add(1, std::memory_order_release);
+        });
+    }
+
+    std::size_t applied_count = 0;
+    while (producers_done.load(std::memory_order_acquire) < producer_count)
+        applied_count += queue.apply(target);
+
+    for (auto& producer : producers)
+        producer.join();
+
+    // A producer can be between its two stores when the last apply above ran
+    applied_count += queue.apply(target);
+
+    check(applied_count == producer_count * commands_per_producer, "apply reports every command once");
+
+    for (unsigned int producer = 0; producer < producer_count; producer++)
+    {
+        const std::vector<unsigned int>& applied = target.applied[producer];
+        check(applied.size() == commands_per_producer, "every command of a producer is applied exactly once");
+
+        bool in_order = true;
+        for (std::size_t i = 0; i < applied.size(); i++)
+            in_order = in_order && applied[i] == i;
+        check(in_order, "commands of one producer are applied in posting order");
+
+        bool completed = true;
+        for (auto& future : futures[producer])
+        {
+            completed = completed && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            future.get();
+        }
+        check(completed, "every future is completed once its command is applied");
+    }
+}
+
+// Every field of a published state is derived from one counter, so a mix of two writes shows up as a mismatch
+static window_state make_state(unsigned int counter)
+{
+    return window_state{ counter, ~counter, static_cast<float>(counter & 0xffff), (counter & 1) != 0, static_cast<visibility_states>(counter % 5) };
+}
+
+static bool is_consistent(const window_state& state)
+{
+    unsigned int counter = state.client_width;
+    return state.client_height == ~counter
+        && state.scale == static_cast<float>(counter & 0xffff)
+        && state.active == ((counter & 1) != 0)
+        && state.visibility == static_cast<visibility_states>(counter % 5);
+}
+
+// One writer publishes as fast as it can while readers check that no load ever returns a torn state
+// and that a reader never sees the state go back in time
+static void test_seqlock()
+{
+    const unsigned int reader_count = 3;
+    const unsigned int write_count = 2000000;
+
+    details::seqlock<window_state> published(make_state(0));
+    std::atomic<bool> writing(true);
+    std::atomic<unsigned int> torn(0);
+    std::atomic<unsigned int> backwards(0);
+
+    std::vector<std::thread> readers;
+    for (unsigned int reader = 0; reader < reader_count; reader++)
+    {
+        readers.emplace_back([&]()
+        {
+            unsigned int last = 0;
+            while (writing.load(std::memory_order_acquire))
+            {
+                window_state state = published.load();
+                if (!is_consistent(state))
+                    torn.fetch_add(1, std::memory_order_relaxed);
+                if (state.client_width < last)
+                    backwards.fetch_add(1, std::memory_order_relaxed);
+                last = state.client_width;
+            }
+        });
+    }
+
+    for (unsigned int i = 1; i <= write_count; i++)
+        published.store(make_state(i));
+    writing.store(false, std::memory_order_release);
+
+    for (auto& reader : readers)
+        reader.join();
+
+    check(torn.load() == 0, "seqlock readers never observe a torn window_state");
+    check(backwards.load() == 0, "seqlock readers never observe an older state after a newer one");
+    check(is_consistent(published.load()) && published.load().client_width == write_count, "seqlock holds the last write");
+}
+
+int main()
+{
+    test_command_queue();
+    test_seqlock();
+
+    if (failures == 0)
+        std::cout << "All concurrency checks passed\n";
+
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <accel/window_recording>
+
+using namespace accel;
+
+// Runs without a display, every check goes through files on disk
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
+
+// Only the type and the bytes of the active member are recorded, the rest of the union is not compared
+static bool same_event(const generic_event& a, const generic_event& b)
+{
+    if (a.type != b.type)
+        return false;
+
+    std::size_t size = details::get_event_payload_size(a.type);
+    return std::memcmp(&a.mouse_up, &b.mouse_up, size) == 0;
+}
+
+static std::vector<generic_event> replay_all(const char* path, std::size_t& polls)
+{
+    std::vector<generic_event> events;
+    event_replay replay(path, replay_speeds::maximum);
+
+    polls = 0;
+    while (!replay.is_finished())
+    {
+        replay.poll_events(std::back_inserter(events));
+        polls++;
+    }
+
+    return events;
+}
+
+static void write_header(const char* path, const event_recording_header& header)
+{
+    std::FILE* file = std::fopen(path, "wb");
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fclose(file);
+}
+
+static bool replay_throws(const char* path)
+{
+    try
+    {
+        event_replay replay(path);
+        return false;
+    }
+    catch (const std::runtime_error&)
+    {
+        return true;
+    }
+}
+
+int main()
+{
+    const char* path = "window_recording_test.bin";
+
+    std::vector<generic_event> first;
+    first.push_back(generic_event(mouse_move_event{ 12, -4 }));
+    first.push_back(generic_event(key_down_event{ 42, true }));
+    first.push_back(generic_event(resize_event{ 810, 630, 800, 600 }));
+
+    std::vector<generic_event> second;
+    second.push_back(generic_event(scale_event{ 1.5f }));
+    second.push_back(generic_event(output_event{ output_changes::added, 0x123456789ull }));
+
+    {
+        event_recorder recorder(path);
+        recorder.record(first.begin(), first.end());
+        recorder.record(second.begin(), second.end());
+    }
+
+    std::vector<generic_event> expected(first);
+    expected.insert(expected.end(), second.begin(), second.end());
+
+    // Round trip, each recorded batch comes back as one poll
+    {
+        std::size_t polls = 0;
+        std::vector<generic_event> replayed = replay_all(path, polls);
+
+        check(replayed.size() == expected.size(), "replay returns every recorded event");
+        check(polls <= 2, "maximum speed replays a batch per poll");
+        for (std::size_t i = 0; i < expected.size() && i < replayed.size(); i++)
+            check(same_event(expected[i], replayed[i]), "replayed event matches the recorded one byte for byte");
+    }
+
+    // A record cut short while recording is ignored, the complete ones still replay
+    {
+        std::FILE* file = std::fopen(path, "ab");
+        unsigned char partial[sizeof(event_record) / 2] = {};
+        std::fwrite(partial, sizeof(partial), 1, file);
+        std::fclose(file);
+
+        event_replay replay(path, replay_speeds::maximum);
+        check(replay.get_record_count() == expected.size(), "truncated final record is ignored");
+    }
+
+    // Recordings made by a different format version or event layout are refused
+    {
+        event_recording_header header = details::get_event_recording_header();
+        header.version++;
+        write_header(path, header);
+        check(replay_throws(path), "wrong version is rejected");
+
+        header = details::get_event_recording_header();
+        header.record_size += 8;
+        write_header(path, header);
+        check(replay_throws(path), "wrong record size is rejected");
+
+        header = details::get_event_recording_header();
+        header.magic[0] = 'X';
+        write_header(path, header);
+        check(replay_throws(path), "wrong magic is rejected");
+    }
+
+    std::remove(path);
+
+    if (failures == 0)
+        std::cout << "All recording checks passed\n";
+
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -29,7 +29,7 @@ int main(int argc, char* argv[])
                     break;
                 
                 case event_types::mouse_scroll:
-                    std::string dirs[2] = { "up", "down" };
+                    std::string dirs[3] = { "up", "down", "none" };
                     std::cout << "Scroll: " << dirs[static_cast<int>(event.mouse_scroll.direction)] << "\n";
                     break;
             }